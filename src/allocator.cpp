@@ -0,0 +1,272 @@
+#include "allocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <imgui.h>
+#include <new>
+#include <tbb/scalable_allocator.h>
+
+namespace {
+
+// command scoped memory of one frame, mostly small descriptor and pipeline
+// creation scratch
+constexpr size_t arena_size = 4 << 20;
+
+// one live block in the packed arena state, the offset below stays under 2^32
+constexpr uint64_t arena_block = uint64_t(1) << 32;
+constexpr uint64_t arena_head  = arena_block - 1;
+static_assert(arena_size < arena_block);
+
+// placed right in front of every block, the block is freed by the backend
+// and accounted to the scope it was allocated with
+struct Header {
+    uint64_t size;
+    uint32_t offset;
+    uint8_t  alignment_log2;
+    uint8_t  backend;
+    uint8_t  scope;
+    uint8_t  reserved;
+};
+static_assert(sizeof(Header) == 16);
+
+// room in front of the block for the header, keeps the block aligned
+size_t header_room(size_t alignment) {
+    return std::max(sizeof(Header), alignment);
+}
+
+Header *header_of(void *ptr) {
+    return reinterpret_cast<Header *>(static_cast<std::byte *>(ptr) - sizeof(Header));
+}
+
+Allocator::Scope scope_of(VkSystemAllocationScope scope) {
+    switch (scope) {
+    case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+        return Allocator::Scope::VulkanCommand;
+    case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+        return Allocator::Scope::VulkanObject;
+    case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+        return Allocator::Scope::VulkanCache;
+    case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+        return Allocator::Scope::VulkanDevice;
+    default:
+        return Allocator::Scope::VulkanInstance;
+    }
+}
+
+void *VKAPI_CALL vulkan_allocate(void *user_data, size_t size, size_t alignment,
+                                 VkSystemAllocationScope scope) {
+    return static_cast<Allocator *>(user_data)->allocate(size, alignment, scope_of(scope));
+}
+
+void *VKAPI_CALL vulkan_reallocate(void *user_data, void *ptr, size_t size, size_t alignment,
+                                   VkSystemAllocationScope scope) {
+    return static_cast<Allocator *>(user_data)->reallocate(ptr, size, alignment,
+                                                            scope_of(scope));
+}
+
+void VKAPI_CALL vulkan_free(void *user_data, void *ptr) {
+    static_cast<Allocator *>(user_data)->deallocate(ptr);
+}
+
+void *imgui_allocate(size_t size, void *user_data) {
+    return static_cast<Allocator *>(user_data)->allocate(size, alignof(std::max_align_t),
+                                                          Allocator::Scope::ImGui);
+}
+
+void imgui_free(void *ptr, void *user_data) {
+    static_cast<Allocator *>(user_data)->deallocate(ptr);
+}
+
+// what ImGui uses by default, its own wrappers are not exported
+void *system_allocate(size_t size, void *user_data) {
+    (void) user_data;
+    return std::malloc(size);
+}
+
+void system_free(void *ptr, void *user_data) {
+    (void) user_data;
+    std::free(ptr);
+}
+
+} // namespace
+
+Allocator::Counters Allocator::FrameStats::total() const {
+    Counters total;
+    for (const auto &scope : this->scopes) {
+        total.allocations += scope.allocations;
+        total.frees += scope.frees;
+        total.bytes += scope.bytes;
+        total.live += scope.live;
+        total.peak += scope.peak;
+    }
+    return total;
+}
+
+Allocator::Allocator() : arena(new std::byte[arena_size]) {
+    this->callbacks.pUserData       = this;
+    this->callbacks.pfnAllocation   = vulkan_allocate;
+    this->callbacks.pfnReallocation = vulkan_reallocate;
+    this->callbacks.pfnFree         = vulkan_free;
+}
+
+Allocator::~Allocator() = default;
+
+void Allocator::install_imgui() {
+    ImGui::SetAllocatorFunctions(imgui_allocate, imgui_free, this);
+}
+
+void Allocator::uninstall_imgui() {
+    ImGui::SetAllocatorFunctions(system_allocate, system_free, nullptr);
+}
+
+void *Allocator::allocate(size_t size, size_t alignment, Scope scope) {
+    if (size == 0) {
+        return nullptr;
+    }
+    alignment = std::max(alignment, alignof(Header));
+
+    Backend backend = this->get_backend();
+    size_t  room    = 0;
+    void   *ptr     = nullptr;
+
+    if (backend == Backend::FrameArena) {
+        ptr = scope == Scope::VulkanCommand ? this->allocate_arena(size, alignment) : nullptr;
+        // everything the arena does not take, including its overflow
+        backend = ptr ? Backend::FrameArena : Backend::TbbMalloc;
+    }
+    if (ptr == nullptr) {
+        room = header_room(alignment);
+        void *base
+            = backend == Backend::System
+                ? ::operator new(room + size, std::align_val_t(alignment), std::nothrow)
+                : scalable_aligned_malloc(room + size, alignment);
+        if (base == nullptr) {
+            return nullptr;
+        }
+        ptr = static_cast<std::byte *>(base) + room;
+    }
+
+    Header *header         = header_of(ptr);
+    header->size           = size;
+    header->offset         = static_cast<uint32_t>(room);
+    header->alignment_log2 = static_cast<uint8_t>(std::countr_zero(alignment));
+    header->backend        = static_cast<uint8_t>(backend);
+    header->scope          = static_cast<uint8_t>(scope);
+
+    AtomicCounters &counters = this->counters[static_cast<size_t>(scope)];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    const uint64_t live = counters.live.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t       peak = counters.peak.load(std::memory_order_relaxed);
+    while (peak < live
+           && !counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return ptr;
+}
+
+void *Allocator::reallocate(void *ptr, size_t size, size_t alignment, Scope scope) {
+    if (ptr == nullptr) {
+        return this->allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        this->deallocate(ptr);
+        return nullptr;
+    }
+
+    void *next = this->allocate(size, alignment, scope);
+    if (next != nullptr) {
+        std::memcpy(next, ptr, std::min<size_t>(size, header_of(ptr)->size));
+        this->deallocate(ptr);
+    }
+    return next;
+}
+
+void Allocator::deallocate(void *ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    const Header    header   = *header_of(ptr);
+    AtomicCounters &counters = this->counters[header.scope];
+    counters.frees.fetch_add(1, std::memory_order_relaxed);
+    counters.live.fetch_sub(header.size, std::memory_order_relaxed);
+
+    std::byte *base = static_cast<std::byte *>(ptr) - header.offset;
+    switch (static_cast<Backend>(header.backend)) {
+    case Backend::System:
+        ::operator delete(base, std::align_val_t(size_t(1) << header.alignment_log2));
+        break;
+    case Backend::TbbMalloc:
+        scalable_aligned_free(base);
+        break;
+    case Backend::FrameArena:
+        this->arena_state.fetch_sub(arena_block, std::memory_order_release);
+        break;
+    }
+}
+
+void *Allocator::allocate_arena(size_t size, size_t alignment) {
+    // bump allocation, the header sits in the gap in front of the block, the
+    // block is counted live by the same exchange that claims it
+    const uintptr_t origin = reinterpret_cast<uintptr_t>(this->arena.get());
+    uint64_t        state  = this->arena_state.load(std::memory_order_relaxed);
+    size_t          begin, end;
+    do {
+        const size_t head = state & arena_head;
+        begin = ((origin + head + sizeof(Header) + alignment - 1) & ~(alignment - 1)) - origin;
+        end   = begin + size;
+        if (end > arena_size) {
+            return nullptr;
+        }
+    } while (!this->arena_state.compare_exchange_weak(
+        state, ((state & ~arena_head) + arena_block) | end, std::memory_order_acq_rel,
+        std::memory_order_relaxed));
+
+    return this->arena.get() + begin;
+}
+
+void Allocator::next_frame() {
+    for (size_t i = 0; i < scope_count; ++i) {
+        AtomicCounters &counters = this->counters[i];
+        Counters       &stats    = this->frame_stats.scopes[i];
+
+        const uint64_t live = counters.live.load(std::memory_order_relaxed);
+        stats.allocations   = counters.allocations.exchange(0, std::memory_order_relaxed);
+        stats.frees         = counters.frees.exchange(0, std::memory_order_relaxed);
+        stats.bytes         = counters.bytes.exchange(0, std::memory_order_relaxed);
+        stats.live          = live;
+        stats.peak          = std::max(counters.peak.exchange(live, std::memory_order_relaxed),
+                                       live);
+    }
+
+    // command scoped memory never outlives the call that allocated it, at the
+    // frame boundary the arena is normally empty, a driver thread claiming or
+    // freeing a block meanwhile fails the exchange and the rewind waits for a
+    // later frame
+    uint64_t state = this->arena_state.load(std::memory_order_acquire);
+    if (state != 0 && (state & ~arena_head) == 0) {
+        this->arena_state.compare_exchange_strong(state, 0, std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed);
+    }
+}
+
+const char *Allocator::scope_name(Scope scope) {
+    switch (scope) {
+    case Scope::ImGui:
+        return "imgui";
+    case Scope::VulkanCommand:
+        return "vulkan command";
+    case Scope::VulkanObject:
+        return "vulkan object";
+    case Scope::VulkanCache:
+        return "vulkan cache";
+    case Scope::VulkanDevice:
+        return "vulkan device";
+    case Scope::VulkanInstance:
+        return "vulkan instance";
+    default:
+        return "unknown";
+    }
+}
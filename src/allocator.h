@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+// host memory of ImGui and the Vulkan driver, served by one of a few
+// interchangeable backends and counted per frame and per scope
+class Allocator {
+public:
+    enum class Backend : uint8_t {
+        System,
+        TbbMalloc,
+        // command scoped driver memory comes from an arena rewound every
+        // frame, everything else goes to tbbmalloc; ImGui stays out of it as
+        // its blocks are vectors kept and reused across frames, which would
+        // hold the arena from ever rewinding
+        FrameArena,
+    };
+
+    enum class Scope : uint8_t {
+        ImGui,
+        VulkanCommand,
+        VulkanObject,
+        VulkanCache,
+        VulkanDevice,
+        VulkanInstance,
+        Count,
+    };
+
+    static constexpr size_t scope_count = static_cast<size_t>(Scope::Count);
+
+    struct Counters {
+        uint64_t allocations{0};
+        uint64_t frees{0};
+        // bytes handed out during the frame
+        uint64_t bytes{0};
+        // bytes alive at the end of the frame and the most alive at once
+        uint64_t live{0};
+        uint64_t peak{0};
+    };
+
+    struct FrameStats {
+        std::array<Counters, scope_count> scopes;
+
+        const Counters &operator[](Scope scope) const {
+            return this->scopes[static_cast<size_t>(scope)];
+        }
+
+        Counters total() const;
+    };
+
+    Allocator();
+    ~Allocator();
+
+    Allocator(const Allocator &)            = delete;
+    Allocator &operator=(const Allocator &) = delete;
+
+    // takes effect for new allocations, blocks remember where they came from
+    // so switching while memory is alive is fine
+    void set_backend(Backend backend) noexcept {
+        this->backend.store(backend, std::memory_order_relaxed);
+    }
+
+    Backend get_backend() const noexcept {
+        return this->backend.load(std::memory_order_relaxed);
+    }
+
+    // route ImGui through this allocator, before the first context is created
+    void install_imgui();
+
+    // hand ImGui back to malloc, once the last context and atlas are gone
+    void uninstall_imgui();
+
+    // callbacks to pass wherever Vulkan takes a VkAllocationCallbacks
+    VkAllocationCallbacks *vulkan_callbacks() noexcept {
+        return &this->callbacks;
+    }
+
+    void *allocate(size_t size, size_t alignment, Scope scope);
+
+    void *reallocate(void *ptr, size_t size, size_t alignment, Scope scope);
+
+    void deallocate(void *ptr) noexcept;
+
+    // close the current frame, its counters become the last frame stats and
+    // the arena is rewound when nothing in it is alive, UI thread only
+    void next_frame();
+
+    // counters of the last finished frame
+    const FrameStats &get_frame_stats() const noexcept {
+        return this->frame_stats;
+    }
+
+    static const char *scope_name(Scope scope);
+
+private:
+    struct AtomicCounters {
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> frees{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> live{0};
+        std::atomic<uint64_t> peak{0};
+    };
+
+    void *allocate_arena(size_t size, size_t alignment);
+
+    std::atomic<Backend> backend{Backend::System};
+
+    std::array<AtomicCounters, scope_count> counters;
+    FrameStats                              frame_stats;
+
+    // blocks alive in the high half and the bump offset in the low half, one
+    // word so the rewind can check both against concurrent claims
+    std::unique_ptr<std::byte[]> arena;
+    std::atomic<uint64_t>        arena_state{0};
+
+    VkAllocationCallbacks callbacks{};
+};
@@ -2,168 +2,1013 @@
 #include "application.h"
 #include "imgui_demo.cpp"
 #include "widget.h"
+#include <algorithm>
+#include <cctype>
 #include <exception>
+#include <stdexec/execution.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 ImVec4 Application::clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+namespace {
+
+// longest the low latency mode waits for the previous frame, a window that is
+// hidden or minimized may never present it
+constexpr uint64_t present_wait_timeout = 100'000'000;
+
+// glfw calls back while polling, route every event to the context of the
+// window it belongs to
+template <typename Callback, typename... Args>
+void forward_event(Callback callback, GLFWwindow *handle, Args... args) {
+    auto         *window   = static_cast<Window *>(glfwGetWindowUserPointer(handle));
+    ImGuiContext *previous = ImGui::GetCurrentContext();
+    ImGui::SetCurrentContext(window->get_context());
+    callback(handle, args...);
+    ImGui::SetCurrentContext(previous);
+}
+
+// hand an input event to the ImGui backend of its window, live and replayed
+// events take the same path
+void dispatch(Window &window, const Recorder::Event &event) {
+    GLFWwindow *handle = window.get_handle();
+    const auto &args   = event.args;
+    switch (event.type) {
+    case Recorder::Type::WindowFocus:
+        forward_event(ImGui_ImplGlfw_WindowFocusCallback, handle, args[0]);
+        break;
+    case Recorder::Type::CursorEnter:
+        forward_event(ImGui_ImplGlfw_CursorEnterCallback, handle, args[0]);
+        break;
+    case Recorder::Type::CursorPos:
+        forward_event(ImGui_ImplGlfw_CursorPosCallback, handle, event.x, event.y);
+        break;
+    case Recorder::Type::MouseButton:
+        forward_event(ImGui_ImplGlfw_MouseButtonCallback, handle, args[0], args[1], args[2]);
+        break;
+    case Recorder::Type::Scroll:
+        forward_event(ImGui_ImplGlfw_ScrollCallback, handle, event.x, event.y);
+        break;
+    case Recorder::Type::Key:
+        forward_event(ImGui_ImplGlfw_KeyCallback, handle, args[0], args[1], args[2], args[3]);
+        break;
+    case Recorder::Type::Char:
+        forward_event(ImGui_ImplGlfw_CharCallback, handle, static_cast<unsigned int>(args[0]));
+        break;
+    case Recorder::Type::WindowState:
+        forward_event(ImGui_ImplGlfw_WindowFocusCallback, handle, args[2]);
+        forward_event(ImGui_ImplGlfw_CursorEnterCallback, handle, args[3]);
+        if (args[3]) {
+            forward_event(ImGui_ImplGlfw_CursorPosCallback, handle, event.x, event.y);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// layout file of a secondary window, named after the title it was opened
+// with so it survives a change in the order windows are opened
+std::string ini_filename(const std::string &title, uint32_t id) {
+    std::string name = "imgui-";
+    for (char c : title) {
+        const auto byte = static_cast<unsigned char>(c);
+        name.push_back(std::isalnum(byte) ? static_cast<char>(std::tolower(byte)) : '-');
+    }
+    if (title.empty()) {
+        name += std::to_string(id);
+    }
+    return name + ".ini";
+}
+
+// x11 leaves a modifier out of the mods of its own press and keeps it in
+// those of its release
+int key_modifier(int key) {
+    switch (key) {
+    case GLFW_KEY_LEFT_CONTROL:
+    case GLFW_KEY_RIGHT_CONTROL:
+        return GLFW_MOD_CONTROL;
+    case GLFW_KEY_LEFT_SHIFT:
+    case GLFW_KEY_RIGHT_SHIFT:
+        return GLFW_MOD_SHIFT;
+    case GLFW_KEY_LEFT_ALT:
+    case GLFW_KEY_RIGHT_ALT:
+        return GLFW_MOD_ALT;
+    case GLFW_KEY_LEFT_SUPER:
+    case GLFW_KEY_RIGHT_SUPER:
+        return GLFW_MOD_SUPER;
+    default:
+        return 0;
+    }
+}
+
+// since imgui 1.89.2 the glfw backend reads the modifiers of key and mouse
+// button events from the live keyboard and ignores their mods, a replay
+// queues the recorded ones after the event so they win
+void replay_modifiers(Window &window, const Recorder::Event &event) {
+    int mods;
+    if (event.type == Recorder::Type::Key) {
+        const int modifier = key_modifier(event.args[0]);
+        mods = event.args[2] == GLFW_RELEASE ? event.args[3] & ~modifier
+                                             : event.args[3] | modifier;
+    } else if (event.type == Recorder::Type::MouseButton) {
+        mods = event.args[2];
+    } else {
+        return;
+    }
+
+    ImGuiContext *previous = ImGui::GetCurrentContext();
+    ImGui::SetCurrentContext(window.get_context());
+    ImGuiIO &io = ImGui::GetIO();
+    io.AddKeyEvent(ImGuiMod_Ctrl, (mods & GLFW_MOD_CONTROL) != 0);
+    io.AddKeyEvent(ImGuiMod_Shift, (mods & GLFW_MOD_SHIFT) != 0);
+    io.AddKeyEvent(ImGuiMod_Alt, (mods & GLFW_MOD_ALT) != 0);
+    io.AddKeyEvent(ImGuiMod_Super, (mods & GLFW_MOD_SUPER) != 0);
+    ImGui::SetCurrentContext(previous);
+}
+
+} // namespace
+
+Window::~Window() {
+    delete this->pending_root.exchange(nullptr, std::memory_order_acquire);
+}
+
+void Window::set_root(std::unique_ptr<Widget> root) {
+    // the old root is gone and a new one may take its address
+    this->root          = std::move(root);
+    this->gathered_root = nullptr;
+}
+
+void Window::publish_root(std::unique_ptr<Widget> root) {
+    delete this->pending_root.exchange(root.release(), std::memory_order_acq_rel);
+}
+
+Widget *Window::get_root() {
+    return this->root.get();
+}
+
+void Application::install_callbacks(GLFWwindow *handle) {
+    // every callback only packs its arguments, recording, replay and the
+    // context switch happen in input_event
+    static constexpr auto input = [](GLFWwindow *handle, const Recorder::Event &event) {
+        auto *window = static_cast<Window *>(glfwGetWindowUserPointer(handle));
+        window->application->input_event(*window, event);
+    };
+
+    glfwSetWindowFocusCallback(handle, [](GLFWwindow *window, int focused) {
+        input(window, {.type = Recorder::Type::WindowFocus, .args = {focused}});
+    });
+    glfwSetCursorEnterCallback(handle, [](GLFWwindow *window, int entered) {
+        input(window, {.type = Recorder::Type::CursorEnter, .args = {entered}});
+    });
+    glfwSetCursorPosCallback(handle, [](GLFWwindow *window, double x, double y) {
+        input(window, {.type = Recorder::Type::CursorPos, .x = x, .y = y});
+    });
+    glfwSetMouseButtonCallback(handle, [](GLFWwindow *window, int button, int action, int mods) {
+        input(window, {.type = Recorder::Type::MouseButton, .args = {button, action, mods}});
+    });
+    glfwSetScrollCallback(handle, [](GLFWwindow *window, double x, double y) {
+        input(window, {.type = Recorder::Type::Scroll, .x = x, .y = y});
+    });
+    glfwSetKeyCallback(handle, [](GLFWwindow *window, int key, int scancode, int action,
+                                  int mods) {
+        input(window, {.type = Recorder::Type::Key, .args = {key, scancode, action, mods}});
+    });
+    glfwSetCharCallback(handle, [](GLFWwindow *window, unsigned int c) {
+        input(window, {.type = Recorder::Type::Char, .args = {static_cast<int32_t>(c)}});
+    });
+    // not an ImGui input, recorded so a replay resizes the window the same way
+    glfwSetWindowSizeCallback(handle, [](GLFWwindow *window, int width, int height) {
+        input(window, {.type = Recorder::Type::WindowSize, .args = {width, height}});
+    });
+}
+
+void Application::input_event(Window &window, Recorder::Event event) {
+    switch (this->recorder.get_mode()) {
+    case Recorder::Mode::Replay:
+        return;
+    case Recorder::Mode::Record:
+        event.frame  = static_cast<uint32_t>(this->frame_count);
+        event.window = window.id;
+        this->recorder.write(event);
+        break;
+    default:
+        break;
+    }
+    this->deliver(window, event);
+}
+
+void Application::deliver(Window &window, const Recorder::Event &event) {
+    // glfw has no event timestamps, the event arrived some time after the
+    // previous poll, including while waiting for the present
+    if (event.type != Recorder::Type::WindowSize && event.type != Recorder::Type::WindowState) {
+        window.input_times.push_back(this->last_poll);
+    }
+    dispatch(window, event);
+}
+
+void Application::record_window_states() {
+    for (auto &entry : this->windows) {
+        Window &window = *entry;
+        if (window.state_recorded) {
+            continue;
+        }
+        window.state_recorded = true;
+
+        int width, height;
+        glfwGetWindowSize(window.handle, &width, &height);
+        Recorder::Event event{
+            .frame  = static_cast<uint32_t>(this->frame_count),
+            .type   = Recorder::Type::WindowState,
+            .window = window.id,
+            .args   = {width, height, glfwGetWindowAttrib(window.handle, GLFW_FOCUSED),
+                       glfwGetWindowAttrib(window.handle, GLFW_HOVERED)},
+        };
+        glfwGetCursorPos(window.handle, &event.x, &event.y);
+        this->recorder.write(event);
+
+        // the recording run sees the same state as its replay
+        this->deliver(window, event);
+    }
+}
+
+bool Application::has_present_wait() const {
+    return g_PresentWait;
+}
+
+void Application::wait_for_present() {
+    if (g_PresentWait) {
+        for (auto &window : this->windows) {
+            if (window->presented_id != 0) {
+                FrameWaitPresent(&window->data, window->presented_id, present_wait_timeout);
+                window->presented_id = 0;
+            }
+        }
+        return;
+    }
+
+    // without present wait the best guess is the gpu finishing the last
+    // batch, the present itself may still be queued behind a vblank
+    if (this->submit_count == 0) {
+        return;
+    }
+    VkFence  fence = this->submit_fences[this->submit_count % this->submit_fences.size()];
+    VkResult err   = vkWaitForFences(g_Device, 1, &fence, VK_TRUE, present_wait_timeout);
+    if (err != VK_TIMEOUT) {
+        check_vk_result(err);
+    }
+}
+
+void Application::collect_presents() {
+    for (auto &window : this->windows) {
+        auto  &inputs   = window->presented_inputs;
+        size_t resolved = 0;
+        while (resolved < inputs.size()) {
+            const uint64_t id = inputs[resolved].first;
+            if (!FrameWaitPresent(&window->data, id, 0)) {
+                break;
+            }
+            const auto completed = std::chrono::steady_clock::now();
+            for (; resolved < inputs.size() && inputs[resolved].first == id; ++resolved) {
+                this->input_latency.add(
+                    std::chrono::duration<double>(completed - inputs[resolved].second).count());
+            }
+        }
+        inputs.erase(inputs.begin(), inputs.begin() + resolved);
+    }
+}
+
+bool Application::record_input(const std::string &path) {
+    return this->recorder.record(path);
+}
+
+bool Application::replay_input(const std::string &path) {
+    return this->recorder.replay(path);
+}
+
+bool Application::write_timings(const std::string &path) {
+    this->timings = std::fopen(path.c_str(), "w");
+    if (this->timings == nullptr) {
+        return false;
+    }
+    std::fprintf(this->timings, "frame,wait_ms,poll_ms,sync_ms,update_ms,render_ms,record_ms,"
+                                "draw_calls,upload_bytes,allocations\n");
+    return true;
+}
+
+void Application::set_update_handler(uint32_t channel, std::function<void(double)> handler) {
+    if (channel >= this->update_handlers.size()) {
+        this->update_handlers.resize(channel + 1);
+    }
+    this->update_handlers[channel] = std::move(handler);
+}
+
+void Application::post_update(uint32_t channel, double value) {
+    std::lock_guard<std::mutex> lock(this->update_mutex);
+    this->posted_updates.emplace_back(channel, value);
+}
+
+void Application::apply_updates() {
+    {
+        // a replay applies the recorded updates queued by poll_events, the
+        // live ones would land in different frames
+        std::lock_guard<std::mutex> lock(this->update_mutex);
+        if (this->recorder.get_mode() != Recorder::Mode::Replay) {
+            this->pending_updates.insert(this->pending_updates.end(),
+                                         this->posted_updates.begin(),
+                                         this->posted_updates.end());
+        }
+        this->posted_updates.clear();
+    }
+
+    for (const auto &[channel, value] : this->pending_updates) {
+        if (this->recorder.get_mode() == Recorder::Mode::Record) {
+            Recorder::Event event;
+            event.frame   = static_cast<uint32_t>(this->frame_count);
+            event.type    = Recorder::Type::Update;
+            event.args[0] = static_cast<int32_t>(channel);
+            event.x       = value;
+            this->recorder.write(event);
+        }
+        if (channel < this->update_handlers.size() && this->update_handlers[channel]) {
+            this->update_handlers[channel](value);
+        }
+    }
+    this->pending_updates.clear();
+}
+
+void Application::write_frame_timings() {
+    const FrameTimings &timings = this->frame_timings;
+    const RenderStats  &render  = this->render_stats;
+    std::fprintf(this->timings, "%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%llu,%llu\n",
+                 static_cast<unsigned long long>(this->frame_count - 1),
+                 timings.wait_seconds * 1000.0, timings.poll_seconds * 1000.0,
+                 timings.sync_seconds * 1000.0, timings.update_seconds * 1000.0,
+                 timings.render_seconds * 1000.0, render.record_seconds * 1000.0,
+                 render.draw_calls,
+                 static_cast<unsigned long long>(render.upload_bytes),
+                 static_cast<unsigned long long>(
+                     this->allocator.get_frame_stats().total().allocations));
+}
+
 void Application::init() {
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         std::terminate();
 
-    // Create window with Vulkan context
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    window = glfwCreateWindow(1280, 720, "Application", NULL, NULL);
     if (!glfwVulkanSupported()) {
         printf("GLFW: Vulkan Not Supported\n");
         std::terminate();
     }
+    // route ImGui and the driver through the allocator before either of them
+    // allocates anything
+    this->allocator.install_imgui();
+    g_Allocator = this->allocator.vulkan_callbacks();
+
     uint32_t     extensions_count = 0;
     const char **extensions       = glfwGetRequiredInstanceExtensions(&extensions_count);
     SetupVulkan(extensions, extensions_count);
 
+    // created signaled, the first batches have nothing to wait for
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
+    for (auto &fence : this->submit_fences) {
+        VkResult err = vkCreateFence(g_Device, &fence_info, g_Allocator, &fence);
+        check_vk_result(err);
+    }
+
+    if (this->render_backend == RenderBackend::InTree) {
+        Renderer::InitInfo info;
+        info.physical_device = g_PhysicalDevice;
+        info.device          = g_Device;
+        info.queue           = g_Queue;
+        info.queue_family    = g_QueueFamily;
+        info.descriptor_pool = g_DescriptorPool;
+        info.pipeline_cache  = g_PipelineCache;
+        info.allocator       = g_Allocator;
+        this->renderer       = std::make_unique<Renderer>(info);
+        this->renderer->upload_fonts();
+    }
+
+    this->create_window("Application", 1280, 720);
+
+    this->last_frame = std::chrono::steady_clock::now();
+    this->last_poll  = this->last_frame;
+}
+
+Window *Application::create_window(const std::string &title, int width, int height) {
+    auto window = std::make_unique<Window>();
+
+    // Create window with Vulkan context
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    window->application = this;
+    window->id          = this->next_window_id++;
+    window->handle      = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
+    glfwSetWindowUserPointer(window->handle, window.get());
+
     // Create Window Surface
     VkSurfaceKHR surface;
-    VkResult     err = glfwCreateWindowSurface(g_Instance, window, g_Allocator, &surface);
+    VkResult     err = glfwCreateWindowSurface(g_Instance, window->handle, g_Allocator, &surface);
     check_vk_result(err);
 
     // Create Framebuffers
     int w, h;
-    glfwGetFramebufferSize(window, &w, &h);
-    ImGui_ImplVulkanH_Window *wd = &g_MainWindowData;
+    glfwGetFramebufferSize(window->handle, &w, &h);
+    ImGui_ImplVulkanH_Window *wd = &window->data;
     SetupVulkanWindow(wd, surface, w, h);
+    window->frame_batch.assign(wd->ImageCount, 0);
 
-    // Setup Dear ImGui context
+    // Setup Dear ImGui context, every window gets its own so the widgets of
+    // one window never see the input or the layout of another
     IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
+    ImGuiContext *previous = ImGui::GetCurrentContext();
+    window->context        = ImGui::CreateContext(
+        this->renderer ? this->renderer->get_font_atlas() : nullptr);
+    ImGui::SetCurrentContext(window->context);
     ImGuiIO &io = ImGui::GetIO();
     (void) io;
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
+    if (window->id != 0) {
+        // the contexts would overwrite each other's layout in one file, the
+        // primary window keeps imgui.ini
+        window->ini_filename = ini_filename(title, window->id);
+        io.IniFilename       = window->ini_filename.c_str();
+    }
+    if (this->recorder.get_mode() != Recorder::Mode::Off) {
+        // a layout loaded from disk would start the replay from another state
+        // than the recording, and neither run may change it for the other
+        io.IniFilename = nullptr;
+    }
 
     // Setup Dear ImGui style
     ImGui::StyleColorsDark();
     // ImGui::StyleColorsLight();
 
-    // Setup Platform/Renderer backends
-    ImGui_ImplGlfw_InitForVulkan(window, true);
-    ImGui_ImplVulkan_InitInfo init_info = {};
-    init_info.Instance                  = g_Instance;
-    init_info.PhysicalDevice            = g_PhysicalDevice;
-    init_info.Device                    = g_Device;
-    init_info.QueueFamily               = g_QueueFamily;
-    init_info.Queue                     = g_Queue;
-    init_info.PipelineCache             = g_PipelineCache;
-    init_info.DescriptorPool            = g_DescriptorPool;
-    init_info.Subpass                   = 0;
-    init_info.MinImageCount             = g_MinImageCount;
-    init_info.ImageCount                = wd->ImageCount;
-    init_info.MSAASamples               = VK_SAMPLE_COUNT_1_BIT;
-    init_info.Allocator                 = g_Allocator;
-    init_info.CheckVkResultFn           = check_vk_result;
-    ImGui_ImplVulkan_Init(&init_info, wd->RenderPass);
-
-    // Upload Fonts
-    {
-        // Use any command queue
-        VkCommandPool   command_pool   = wd->Frames[wd->FrameIndex].CommandPool;
-        VkCommandBuffer command_buffer = wd->Frames[wd->FrameIndex].CommandBuffer;
+    // Setup Platform/Renderer backends, the stock callbacks only know the
+    // current context so ours switch to the window first
+    ImGui_ImplGlfw_InitForVulkan(window->handle, false);
+    this->install_callbacks(window->handle);
+    if (this->renderer) {
+        // the renderer draws every context with the atlas it already uploaded
+        io.BackendRendererName = "application_renderer";
+        io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+        this->renderer->prepare(window->target, wd);
+    } else {
+        ImGui_ImplVulkan_InitInfo init_info = {};
+        init_info.Instance                  = g_Instance;
+        init_info.PhysicalDevice            = g_PhysicalDevice;
+        init_info.Device                    = g_Device;
+        init_info.QueueFamily               = g_QueueFamily;
+        init_info.Queue                     = g_Queue;
+        init_info.PipelineCache             = g_PipelineCache;
+        init_info.DescriptorPool            = g_DescriptorPool;
+        init_info.Subpass                   = 0;
+        init_info.MinImageCount             = g_MinImageCount;
+        init_info.ImageCount                = wd->ImageCount;
+        init_info.MSAASamples               = VK_SAMPLE_COUNT_1_BIT;
+        init_info.Allocator                 = g_Allocator;
+        init_info.CheckVkResultFn           = check_vk_result;
+        ImGui_ImplVulkan_Init(&init_info, wd->RenderPass);
 
-        err = vkResetCommandPool(g_Device, command_pool, 0);
-        check_vk_result(err);
-        VkCommandBufferBeginInfo begin_info = {};
-        begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        err = vkBeginCommandBuffer(command_buffer, &begin_info);
-        check_vk_result(err);
+        // Upload Fonts
+        {
+            // Use any command queue
+            VkCommandPool   command_pool   = wd->Frames[wd->FrameIndex].CommandPool;
+            VkCommandBuffer command_buffer = wd->Frames[wd->FrameIndex].CommandBuffer;
 
-        ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
+            err = vkResetCommandPool(g_Device, command_pool, 0);
+            check_vk_result(err);
+            VkCommandBufferBeginInfo begin_info = {};
+            begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            err = vkBeginCommandBuffer(command_buffer, &begin_info);
+            check_vk_result(err);
 
-        VkSubmitInfo end_info       = {};
-        end_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        end_info.commandBufferCount = 1;
-        end_info.pCommandBuffers    = &command_buffer;
-        err                         = vkEndCommandBuffer(command_buffer);
-        check_vk_result(err);
-        err = vkQueueSubmit(g_Queue, 1, &end_info, VK_NULL_HANDLE);
-        check_vk_result(err);
+            ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
 
-        err = vkDeviceWaitIdle(g_Device);
-        check_vk_result(err);
-        ImGui_ImplVulkan_DestroyFontUploadObjects();
+            VkSubmitInfo end_info       = {};
+            end_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            end_info.commandBufferCount = 1;
+            end_info.pCommandBuffers    = &command_buffer;
+            err                         = vkEndCommandBuffer(command_buffer);
+            check_vk_result(err);
+            err = vkQueueSubmit(g_Queue, 1, &end_info, VK_NULL_HANDLE);
+            check_vk_result(err);
+
+            err = vkDeviceWaitIdle(g_Device);
+            check_vk_result(err);
+            ImGui_ImplVulkan_DestroyFontUploadObjects();
+        }
+    }
+
+    if (previous) {
+        ImGui::SetCurrentContext(previous);
     }
+
+    if (this->recorder.get_mode() == Recorder::Mode::Record) {
+        this->recorder.write({.frame  = static_cast<uint32_t>(this->frame_count),
+                              .type   = Recorder::Type::WindowCreate,
+                              .window = window->id,
+                              .args   = {width, height}});
+    }
+
+    this->windows.push_back(std::move(window));
+    return this->windows.back().get();
 }
 
-void Application::clean() {
+Window *Application::find_window(uint32_t id) {
+    auto it = std::find_if(this->windows.begin(), this->windows.end(),
+                           [id](const auto &window) { return window->id == id; });
+    return it != this->windows.end() ? it->get() : nullptr;
+}
+
+void Application::destroy_window(Window &window) {
     VkResult err = vkDeviceWaitIdle(g_Device);
     check_vk_result(err);
-    ImGui_ImplVulkan_Shutdown();
+
+    ImGui::SetCurrentContext(window.context);
+    if (this->renderer) {
+        this->renderer->release(window.target);
+    } else {
+        ImGui_ImplVulkan_Shutdown();
+    }
     ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    ImGui::DestroyContext(window.context);
+    window.context = nullptr;
 
-    CleanupVulkanWindow();
+    CleanupVulkanWindow(&window.data);
+    glfwDestroyWindow(window.handle);
+    window.handle = nullptr;
+}
+
+void Application::clean() {
+    this->recorder.close(static_cast<uint32_t>(this->frame_count));
+    if (this->timings) {
+        std::fclose(this->timings);
+        this->timings = nullptr;
+    }
+
+    for (auto &bucket : this->retired) {
+        bucket.clear();
+    }
+    stdexec::sync_wait(this->reclaim_scope.on_empty());
+
+    for (auto &window : this->windows) {
+        this->destroy_window(*window);
+    }
+    this->windows.clear();
+
+    for (auto &fence : this->submit_fences) {
+        vkDestroyFence(g_Device, fence, g_Allocator);
+    }
+    this->renderer.reset();
     CleanupVulkan();
+    g_Allocator = NULL;
+    // the shared atlas went with the renderer, nothing ImGui allocated is
+    // left for the allocator to free
+    this->allocator.uninstall_imgui();
 
-    glfwDestroyWindow(window);
     glfwTerminate();
 }
 
 bool Application::should_close() {
-    return glfwWindowShouldClose(window);
+    return glfwWindowShouldClose(this->windows.front()->handle)
+           || this->recorder.finished(static_cast<uint32_t>(this->frame_count));
 }
 
 void Application::poll_events() {
+    // sampling the input right after the previous frame went out keeps it
+    // from waiting in the queue for a full frame
+    const auto waited = std::chrono::steady_clock::now();
+    if (this->low_latency) {
+        this->wait_for_present();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    this->frame_timings.wait_seconds = std::chrono::duration<double>(start - waited).count();
+
+    if (g_PresentWait) {
+        this->collect_presents();
+    }
+
+    if (this->recorder.get_mode() == Recorder::Mode::Record) {
+        this->record_window_states();
+    }
+
     glfwPollEvents();
+
+    if (this->recorder.get_mode() == Recorder::Mode::Replay) {
+        this->recorder.read(static_cast<uint32_t>(this->frame_count),
+                            [this](const Recorder::Event &event) {
+                                if (event.type == Recorder::Type::Update) {
+                                    this->pending_updates.emplace_back(event.args[0], event.x);
+                                    return;
+                                }
+                                Window *found = this->find_window(event.window);
+                                if (found == nullptr) {
+                                    if (event.type == Recorder::Type::WindowCreate) {
+                                        fprintf(stderr,
+                                                "[recorder] window %u of the recording was "
+                                                "not opened by the replay\n",
+                                                event.window);
+                                    }
+                                    return;
+                                }
+                                Window &window = *found;
+                                switch (event.type) {
+                                case Recorder::Type::WindowState:
+                                    glfwSetWindowSize(window.handle, event.args[0],
+                                                      event.args[1]);
+                                    window.replay_focused = event.args[2];
+                                    window.replay_inside  = event.args[3];
+                                    window.replay_x       = event.x;
+                                    window.replay_y       = event.y;
+                                    break;
+                                case Recorder::Type::WindowFocus:
+                                    window.replay_focused = event.args[0];
+                                    break;
+                                case Recorder::Type::CursorEnter:
+                                    window.replay_inside = event.args[0];
+                                    break;
+                                case Recorder::Type::CursorPos:
+                                    window.replay_x = event.x;
+                                    window.replay_y = event.y;
+                                    break;
+                                case Recorder::Type::WindowClose:
+                                    window.replay_closed = true;
+                                    return;
+                                case Recorder::Type::WindowCreate:
+                                    return;
+                                default:
+                                    break;
+                                }
+                                if (event.type == Recorder::Type::WindowSize) {
+                                    glfwSetWindowSize(window.handle, event.args[0],
+                                                      event.args[1]);
+                                } else {
+                                    this->deliver(window, event);
+                                    replay_modifiers(window, event);
+                                }
+                            });
+    }
+    this->last_poll = std::chrono::steady_clock::now();
+    this->frame_timings.poll_seconds
+        = std::chrono::duration<double>(this->last_poll - start).count();
 }
 
 void Application::frame_move() {
-    if (g_SwapChainRebuild) {
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-        if (width > 0 && height > 0) {
-            ImGui_ImplVulkan_SetMinImageCount(g_MinImageCount);
-            ImGui_ImplVulkanH_CreateOrResizeWindow(g_Instance, g_PhysicalDevice, g_Device,
-                                                   &g_MainWindowData, g_QueueFamily, g_Allocator,
-                                                   width, height, g_MinImageCount);
-            g_MainWindowData.FrameIndex = 0;
-            g_SwapChainRebuild          = false;
-        }
+    using clock = std::chrono::steady_clock;
+
+    const auto start = clock::now();
+    float      dt    = std::chrono::duration<float>(start - this->last_frame).count();
+    this->last_frame = start;
+    if (this->fixed_timestep > 0.0f) {
+        dt = this->fixed_timestep;
     }
 
-    // Start the Dear ImGui frame
-    ImGui_ImplVulkan_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    this->apply_updates();
+    this->sync();
+    const auto synced = clock::now();
+    this->update(dt);
+    const auto updated = clock::now();
+    this->render();
+    const auto rendered = clock::now();
+
+    this->frame_timings.sync_seconds   = std::chrono::duration<double>(synced - start).count();
+    this->frame_timings.update_seconds = std::chrono::duration<double>(updated - synced).count();
+    this->frame_timings.render_seconds = std::chrono::duration<double>(rendered - updated).count();
 
-    if (root) {
-        root->render();
+    // closes the frame including the events polled for it
+    this->allocator.next_frame();
+    if (this->timings) {
+        this->write_frame_timings();
     }
+}
+
+void Application::render() {
+    this->batch.clear();
+    this->batch_frames.clear();
+    this->batch_draw_data.clear();
+    this->batch_callbacks.clear();
+
+    // building the frames stays serial, ImGui works on the current context
+    for (auto &window : this->windows) {
+        ImGui_ImplVulkanH_Window *wd = &window->data;
+        ImGui::SetCurrentContext(window->context);
+
+        if (window->swapchain_rebuild) {
+            int width, height;
+            glfwGetFramebufferSize(window->handle, &width, &height);
+            if (width > 0 && height > 0) {
+                if (!this->renderer) {
+                    ImGui_ImplVulkan_SetMinImageCount(g_MinImageCount);
+                }
+                ImGui_ImplVulkanH_CreateOrResizeWindow(g_Instance, g_PhysicalDevice, g_Device, wd,
+                                                       g_QueueFamily, g_Allocator, width, height,
+                                                       g_MinImageCount);
+                if (this->renderer) {
+                    this->renderer->prepare(window->target, wd);
+                }
+                wd->FrameIndex = 0;
+                // the rebuild waited for the device, nothing is in flight
+                window->frame_batch.assign(wd->ImageCount, 0);
+                window->presented_id = 0;
+                window->presented_inputs.clear();
+                window->swapchain_rebuild = false;
+            }
+        }
+
+        // Start the Dear ImGui frame
+        if (!this->renderer) {
+            ImGui_ImplVulkan_NewFrame();
+        }
+        ImGui_ImplGlfw_NewFrame();
+        if (this->recorder.get_mode() == Recorder::Mode::Replay) {
+            // the backend queued the live cursor, the replayed state is
+            // queued after it and wins
+            ImGuiIO &io = ImGui::GetIO();
+            io.AddFocusEvent(window->replay_focused);
+            if (window->replay_inside) {
+                io.AddMousePosEvent(static_cast<float>(window->replay_x),
+                                    static_cast<float>(window->replay_y));
+            } else {
+                io.AddMousePosEvent(-FLT_MAX, -FLT_MAX);
+            }
+        }
+        if (this->fixed_timestep > 0.0f) {
+            ImGui::GetIO().DeltaTime = this->fixed_timestep;
+        }
+        ImGui::NewFrame();
+
+        if (window->root) {
+            window->root->render();
+        }
 
-    // Rendering
-    ImGui::Render();
-    ImDrawData               *draw_data = ImGui::GetDrawData();
-    ImGui_ImplVulkanH_Window *wd        = &g_MainWindowData;
+        // Rendering
+        ImGui::Render();
+        ImDrawData *draw_data = ImGui::GetDrawData();
+
+        const bool is_minimized
+            = (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f);
+        if (is_minimized || window->swapchain_rebuild) {
+            continue;
+        }
+        if (!FrameAcquire(wd)) {
+            window->swapchain_rebuild = true;
+            continue;
+        }
+
+        // the command buffer of this image was last submitted with an older
+        // batch, only wait if that batch's fence has not been reused since
+        const uint64_t last = window->frame_batch[wd->FrameIndex];
+        if (last != 0 && this->submit_count - last < this->submit_fences.size()) {
+            VkFence  fence = this->submit_fences[last % this->submit_fences.size()];
+            VkResult err   = vkWaitForFences(g_Device, 1, &fence, VK_TRUE, UINT64_MAX);
+            check_vk_result(err);
+        }
 
-    const bool is_minimized
-        = (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f);
-    if (!is_minimized) {
         wd->ClearValue.color.float32[0] = clear_color.x * clear_color.w;
         wd->ClearValue.color.float32[1] = clear_color.y * clear_color.w;
         wd->ClearValue.color.float32[2] = clear_color.z * clear_color.w;
         wd->ClearValue.color.float32[3] = clear_color.w;
-        FrameRender(wd, draw_data);
-        FramePresent(wd);
+        window->frame_batch[wd->FrameIndex] = this->submit_count + 1;
+
+        this->batch.push_back(window.get());
+        this->batch_frames.push_back(wd);
+        this->batch_draw_data.push_back(draw_data);
+        this->batch_callbacks.push_back(this->renderer
+                                        && Renderer::has_user_callbacks(draw_data));
+    }
+
+    this->render_stats = RenderStats();
+    if (this->batch.empty()) {
+        return;
+    }
+
+    // draw data stays valid until the next NewFrame of its context, so the
+    // in-tree renderer records all windows at once, the stock backend keeps
+    // its buffers in the current context and has to go one by one
+    const auto   start      = std::chrono::steady_clock::now();
+    const size_t batch_size = this->batch.size();
+    if (this->renderer) {
+        this->batch_stats.resize(batch_size);
+        tbb::parallel_for(size_t(0), batch_size, [this](size_t i) {
+            if (!this->batch_callbacks[i]) {
+                this->batch_stats[i] = this->renderer->record(
+                    this->batch[i]->target, this->batch_frames[i], this->batch_draw_data[i]);
+            }
+        });
+        // user callbacks may call into ImGui, their frames are recorded here
+        // on the UI thread with the context of their window
+        for (size_t i = 0; i < batch_size; ++i) {
+            if (this->batch_callbacks[i]) {
+                ImGui::SetCurrentContext(this->batch[i]->context);
+                this->batch_stats[i] = this->renderer->record(
+                    this->batch[i]->target, this->batch_frames[i], this->batch_draw_data[i]);
+            }
+        }
+        for (const Renderer::Stats &stats : this->batch_stats) {
+            this->render_stats.upload_bytes += stats.upload_bytes;
+            this->render_stats.commands += stats.commands;
+            this->render_stats.draw_calls += stats.draw_calls;
+            this->render_stats.secondaries += stats.secondaries;
+        }
+    } else {
+        for (size_t i = 0; i < batch_size; ++i) {
+            ImDrawData *draw_data = this->batch_draw_data[i];
+            ImGui::SetCurrentContext(this->batch[i]->context);
+            FrameRecord(this->batch_frames[i], draw_data);
+
+            this->render_stats.upload_bytes += draw_data->TotalVtxCount * sizeof(ImDrawVert)
+                                               + draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+            for (int l = 0; l < draw_data->CmdListsCount; ++l) {
+                this->render_stats.commands += draw_data->CmdLists[l]->CmdBuffer.Size;
+            }
+        }
+        this->render_stats.draw_calls = this->render_stats.commands;
+    }
+    this->render_stats.record_seconds
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // one submit for all windows, its fence is free again once the batch
+    // submitted three batches ago has finished
+    const uint64_t index = ++this->submit_count;
+    VkFence        fence = this->submit_fences[index % this->submit_fences.size()];
+    VkResult       err   = vkWaitForFences(g_Device, 1, &fence, VK_TRUE, UINT64_MAX);
+    check_vk_result(err);
+    err = vkResetFences(g_Device, 1, &fence);
+    check_vk_result(err);
+
+    const uint32_t count = static_cast<uint32_t>(this->batch.size());
+    this->batch_submits.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        FrameSubmitInfo(this->batch_frames[i], &this->batch_submits[i]);
+    }
+    err = vkQueueSubmit(g_Queue, count, this->batch_submits.data(), fence);
+    check_vk_result(err);
+
+    this->batch_present_ids.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        this->batch_present_ids[i] = ++this->batch[i]->present_id;
+    }
+
+    this->batch_semaphores.resize(count);
+    this->batch_swapchains.resize(count);
+    this->batch_image_indices.resize(count);
+    this->batch_results.resize(count);
+    FramePresent(this->batch_frames.data(), count, this->batch_present_ids.data(),
+                 this->batch_semaphores.data(), this->batch_swapchains.data(),
+                 this->batch_image_indices.data(), this->batch_results.data());
+    const auto presented = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < count; ++i) {
+        Window        *window = this->batch[i];
+        const VkResult result = this->batch_results[i];
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            window->swapchain_rebuild = true;
+            continue;
+        }
+        window->presented_id = this->batch_present_ids[i];
+        // with present wait the latency ends once the image is on screen,
+        // without it the return of the present call is all there is
+        for (const auto &arrived : window->input_times) {
+            if (g_PresentWait) {
+                window->presented_inputs.emplace_back(window->presented_id, arrived);
+            } else {
+                this->input_latency.add(
+                    std::chrono::duration<double>(presented - arrived).count());
+            }
+        }
+    }
+    // input of windows that did not present is never shown, it is not counted
+    for (auto &window : this->windows) {
+        window->input_times.clear();
+    }
+}
+
+void Application::sync() {
+    // the oldest bucket has been unreachable for a full grace period
+    auto &bucket = this->retired[this->frame_count++ % this->retired.size()];
+    if (!bucket.empty()) {
+        this->reclaim_scope.spawn(stdexec::schedule(this->reclaim_context.get_scheduler())
+                                  | stdexec::then([garbage = std::move(bucket)]() mutable {
+                                        garbage.clear();
+                                    }));
+        bucket.clear();
+    }
+
+    // secondary windows closed by the user go away here, the primary one ends
+    // the main loop instead, a replay closes them in the recorded frame
+    const bool replay = this->recorder.get_mode() == Recorder::Mode::Replay;
+    bool       gather = false;
+    for (size_t i = 1; i < this->windows.size();) {
+        Window &window = *this->windows[i];
+        if (replay ? !window.replay_closed : !glfwWindowShouldClose(window.handle)) {
+            ++i;
+            continue;
+        }
+        if (this->recorder.get_mode() == Recorder::Mode::Record) {
+            // the frame whose events were polled last, the count moved on above
+            this->recorder.write({.frame  = static_cast<uint32_t>(this->frame_count - 1),
+                                  .type   = Recorder::Type::WindowClose,
+                                  .window = window.id});
+        }
+        if (window.root) {
+            bucket.push_back(std::move(window.root));
+        }
+        this->destroy_window(window);
+        this->windows.erase(this->windows.begin() + i);
+        gather = true;
+    }
+
+    for (auto &window : this->windows) {
+        Widget *next = window->pending_root.exchange(nullptr, std::memory_order_acquire);
+        if (next) {
+            if (window->root) {
+                bucket.push_back(std::move(window->root));
+            }
+            window->root.reset(next);
+        }
+        Widget *root = window->root.get();
+        if (root != window->gathered_root
+            || (root && root->get_structure() != window->gathered_structure)) {
+            gather = true;
+        }
+    }
+
+    // the lists may point into subtrees replaced since, they are gathered
+    // before anything is committed through them
+    if (gather) {
+        this->gather();
+    }
+    bool committed = false;
+    for (Widget *widget : this->commit_list) {
+        if (auto replaced = widget->commit()) {
+            bucket.push_back(std::move(replaced));
+            committed = true;
+        }
+    }
+    if (committed) {
+        this->gather();
+    }
+}
+
+void Application::gather() {
+    // the lists keep their capacity between gathers
+    this->update_list.clear();
+    this->commit_list.clear();
+    this->gather_list.clear();
+    for (auto &window : this->windows) {
+        Widget *root               = window->root.get();
+        window->gathered_root      = root;
+        window->gathered_structure = root ? root->get_structure() : 0;
+        if (root) {
+            this->gather_list.push_back(root);
+        }
+    }
+    for (size_t i = 0; i < this->gather_list.size(); ++i) {
+        Widget *widget = this->gather_list[i];
+        if (widget->has_update()) {
+            this->update_list.push_back(widget);
+        }
+        if (widget->has_commit()) {
+            this->commit_list.push_back(widget);
+        }
+        widget->for_each_child([this](Widget *child) { this->gather_list.push_back(child); });
+    }
+}
+
+void Application::update(float dt) {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, this->update_list.size(), 256),
+                      [this, dt](const tbb::blocked_range<size_t> &range) {
+                          for (size_t i = range.begin(); i != range.end(); ++i) {
+                              this->update_list[i]->update(dt);
+                          }
+                      });
+
+    const uint32_t pass = static_cast<uint32_t>(this->frame_count);
+    for (Widget *widget : this->update_list) {
+        widget->flush_invalidation(pass);
     }
 }
 
 GLFWwindow *Application::get_window() {
-    return window;
+    return this->windows.front()->handle;
+}
+
+Window *Application::get_primary_window() {
+    return this->windows.front().get();
 }
 
 void Application::set_root(std::unique_ptr<Widget> root) {
-    this->root = std::move(root);
+    this->windows.front()->set_root(std::move(root));
+}
+
+void Application::publish_root(std::unique_ptr<Widget> root) {
+    this->windows.front()->publish_root(std::move(root));
 }
 
 Widget *Application::get_root() {
-    return root.get();
-}
\ No newline at end of file
+    return this->windows.front()->get_root();
+}
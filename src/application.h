@@ -1,13 +1,132 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <exec/async_scope.hpp>
+#include <exec/single_thread_context.hpp>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
+#include <imgui_impl_vulkan.h>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "allocator.h"
+#include "histogram.h"
+#include "recorder.h"
+#include "renderer.h"
+
+class Application;
 class Widget;
 
+// an OS window with its own swapchain and ImGui context, all windows share
+// the device, the queue and the descriptor pool of the application
+class Window {
+public:
+    Window()  = default;
+    ~Window();
+
+    GLFWwindow *get_handle() {
+        return this->handle;
+    }
+
+    ImGuiContext *get_context() {
+        return this->context;
+    }
+
+    // replace the root immediately, UI thread only
+    void set_root(std::unique_ptr<Widget> root);
+
+    // replace the root from any thread, the new root is picked up at the next
+    // frame boundary
+    void publish_root(std::unique_ptr<Widget> root);
+
+    Widget *get_root();
+
+private:
+    friend class Application;
+
+    Application             *application{nullptr};
+    uint32_t                 id{0};
+    GLFWwindow              *handle{nullptr};
+    ImGuiContext            *context{nullptr};
+    ImGui_ImplVulkanH_Window data{};
+    Renderer::Target         target;
+    bool                     swapchain_rebuild{false};
+
+    // layout file of the context, ImGui only keeps the pointer
+    std::string ini_filename;
+
+    // last present id handed out and the one presented since the last wait,
+    // zero when there is nothing to wait for
+    uint64_t present_id{0};
+    uint64_t presented_id{0};
+
+    // arrival of the input events not presented yet
+    std::vector<std::chrono::steady_clock::time_point> input_times;
+
+    // arrival of the input in presented frames whose present has not
+    // completed yet, with the present id of the frame, oldest first
+    std::vector<std::pair<uint64_t, std::chrono::steady_clock::time_point>> presented_inputs;
+
+    // whether the recording starts with the state of this window yet
+    bool state_recorded{false};
+
+    // focus and cursor as of the replayed events, the backend would read
+    // them from the live window every frame
+    bool   replay_focused{true};
+    bool   replay_inside{false};
+    double replay_x{0.0};
+    double replay_y{0.0};
+    // closed by a replayed event, a replay ignores the live close requests
+    bool replay_closed{false};
+
+    // batch that last submitted each swapchain frame, the command buffer of a
+    // frame is reused once its batch has finished
+    std::vector<uint64_t> frame_batch;
+
+    std::unique_ptr<Widget> root;
+    std::atomic<Widget *>   pending_root{nullptr};
+
+    // root and structure of the root when the widgets were last gathered
+    Widget  *gathered_root{nullptr};
+    uint32_t gathered_structure{0};
+};
+
 class Application {
 public:
+    enum class RenderBackend {
+        // ImGui_ImplVulkan_RenderDrawData, one primary command buffer per
+        // window recorded on the UI thread
+        Stock,
+        // the in-tree Renderer, windows and large frames are recorded in
+        // parallel
+        InTree,
+    };
+
+    // cost of recording the last frame of all windows
+    struct RenderStats {
+        double   record_seconds{0.0};
+        uint64_t upload_bytes{0};
+        uint32_t commands{0};
+        uint32_t draw_calls{0};
+        uint32_t secondaries{0};
+    };
+
+    // wall time of the phases of the last frame
+    struct FrameTimings {
+        double wait_seconds{0.0};
+        double poll_seconds{0.0};
+        double sync_seconds{0.0};
+        double update_seconds{0.0};
+        double render_seconds{0.0};
+    };
+
     Application()  = default;
     ~Application() = default;
 
@@ -21,14 +140,179 @@ public:
 
     void frame_move();
 
+    // open another OS window, it lives until the user closes it or the
+    // application is cleaned up
+    Window *create_window(const std::string &title, int width, int height);
+
+    // handle of the primary window
     GLFWwindow *get_window();
 
+    Window *get_primary_window();
+
+    // root of the primary window
     void set_root(std::unique_ptr<Widget> root);
 
+    void publish_root(std::unique_ptr<Widget> root);
+
     Widget *get_root();
 
+    // host memory of ImGui and Vulkan, pick the backend before init
+    Allocator &get_allocator() {
+        return this->allocator;
+    }
+
+    // pick before init
+    void set_render_backend(RenderBackend backend) noexcept {
+        this->render_backend = backend;
+    }
+
+    const RenderStats &get_render_stats() const noexcept {
+        return this->render_stats;
+    }
+
+    const FrameTimings &get_frame_timings() const noexcept {
+        return this->frame_timings;
+    }
+
+    // wait for the previous frame to be presented before polling input, with
+    // present wait when the device has it and the frame's fence otherwise
+    void set_low_latency(bool enabled) noexcept {
+        this->low_latency = enabled;
+    }
+
+    // whether the low latency mode waits for the present or only the fence
+    bool has_present_wait() const;
+
+    // time from the arrival of every input event to the present of the frame
+    // it went into, from the end of the poll before the one that saw the event
+    // to the completion of the present, which is seen at the next poll, or to
+    // the return of vkQueuePresentKHR without present wait
+    const LatencyHistogram &get_input_latency() const noexcept {
+        return this->input_latency;
+    }
+
+    // write the input of all windows and every posted update to path
+    bool record_input(const std::string &path);
+
+    // feed the input and updates of a recording back frame by frame instead
+    // of the live ones, the application closes after the last recorded frame
+    bool replay_input(const std::string &path);
+
+    // append one csv line with the timings of every frame to path
+    bool write_timings(const std::string &path);
+
+    // advance widgets and ImGui by a constant step instead of the wall clock,
+    // recordings should be made and replayed with the same step
+    void set_fixed_timestep(float dt) noexcept {
+        this->fixed_timestep = dt;
+    }
+
+    // the handler applies the values posted on channel, UI thread only
+    void set_update_handler(uint32_t channel, std::function<void(double)> handler);
+
+    // hand a value from any thread to the handler of channel, it is applied
+    // at the next frame boundary and recorded with the frame it landed in
+    void post_update(uint32_t channel, double value);
+
 private:
-    static ImVec4           clear_color;
-    GLFWwindow             *window;
-    std::unique_ptr<Widget> root;
+    void destroy_window(Window &window);
+
+    // the open window with the id create_window handed out, null once closed
+    Window *find_window(uint32_t id);
+
+    void install_callbacks(GLFWwindow *handle);
+
+    // live input of a window, dropped while replaying
+    void input_event(Window &window, Recorder::Event event);
+
+    // timestamp a live or replayed event and hand it to the window's context
+    void deliver(Window &window, const Recorder::Event &event);
+
+    // record and deliver the state of windows the recording does not cover
+    // yet, before any of their events
+    void record_window_states();
+
+    void wait_for_present();
+
+    // count the input of the frames whose present has completed by now
+    void collect_presents();
+
+    // run the handlers of the updates posted since the last frame
+    void apply_updates();
+
+    void write_frame_timings();
+
+    // commit subtrees published from other threads and gather the widgets
+    // visited every frame again when a tree changed shape
+    void sync();
+
+    // walk the trees of all windows for widgets with an update or a commit
+    void gather();
+
+    // run Widget::update of the gathered widgets in parallel, then carry the
+    // deferred invalidations up to the roots
+    void update(float dt);
+
+    // build the frame of every window and hand them to the GPU in a single
+    // submit and a single present
+    void render();
+
+    static ImVec4 clear_color;
+
+    // declared first, everything below may still hold memory from it
+    Allocator allocator;
+
+    RenderBackend             render_backend{RenderBackend::InTree};
+    std::unique_ptr<Renderer> renderer;
+    RenderStats               render_stats;
+    FrameTimings              frame_timings;
+
+    Recorder   recorder;
+    std::FILE *timings{nullptr};
+    float      fixed_timestep{0.0f};
+
+    bool                                  low_latency{false};
+    LatencyHistogram                      input_latency;
+    std::chrono::steady_clock::time_point last_poll{};
+
+    // posted from any thread under the mutex, applied on the UI thread
+    std::mutex                               update_mutex;
+    std::vector<std::pair<uint32_t, double>> posted_updates;
+    std::vector<std::pair<uint32_t, double>> pending_updates;
+    std::vector<std::function<void(double)>> update_handlers;
+
+    // the first window is the primary one, closing it ends the application
+    std::vector<std::unique_ptr<Window>> windows;
+    uint32_t                             next_window_id{0};
+
+    // one fence per batch in flight
+    std::array<VkFence, 3> submit_fences{};
+    uint64_t               submit_count{0};
+
+    // windows of the batch being built, kept between frames for the capacity
+    std::vector<Window *>                   batch;
+    std::vector<ImGui_ImplVulkanH_Window *> batch_frames;
+    std::vector<ImDrawData *>               batch_draw_data;
+    std::vector<uint8_t>                    batch_callbacks;
+    std::vector<Renderer::Stats>            batch_stats;
+    std::vector<VkSubmitInfo>               batch_submits;
+    std::vector<uint64_t>                   batch_present_ids;
+    std::vector<VkSemaphore>                batch_semaphores;
+    std::vector<VkSwapchainKHR>             batch_swapchains;
+    std::vector<uint32_t>                   batch_image_indices;
+    std::vector<VkResult>                   batch_results;
+
+    // widgets with an update and widgets with a commit, gathered only when a
+    // tree changes shape
+    std::vector<Widget *> update_list;
+    std::vector<Widget *> commit_list;
+    std::vector<Widget *> gather_list;
+    std::chrono::steady_clock::time_point last_frame{};
+
+    // replaced subtrees wait a few frames for stray references to drain, then
+    // get destroyed on the reclaim thread
+    uint64_t                                            frame_count{0};
+    std::array<std::vector<std::unique_ptr<Widget>>, 3> retired;
+    exec::single_thread_context                         reclaim_context;
+    exec::async_scope                                   reclaim_scope;
 };
\ No newline at end of file
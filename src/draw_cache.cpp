@@ -0,0 +1,147 @@
+#include "draw_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <imgui_internal.h>
+
+void DrawCache::begin_capture() {
+    this->draw_list     = ImGui::GetWindowDrawList();
+    this->child_windows = ImGui::GetCurrentWindow()->DC.ChildWindows.Size;
+    this->cmd_start     = this->draw_list->CmdBuffer.Size - 1;
+    this->vtx_start     = this->draw_list->VtxBuffer.Size;
+    this->idx_start     = this->draw_list->IdxBuffer.Size;
+    this->origin        = ImGui::GetCursorScreenPos();
+    this->width         = ImGui::GetContentRegionAvail().x;
+}
+
+bool DrawCache::end_capture(uint32_t revision) {
+    ImDrawList  *draw_list = ImGui::GetWindowDrawList();
+    ImGuiWindow *window    = ImGui::GetCurrentWindow();
+    this->clear();
+
+    // nested child windows and channel splits emit into other buffers we
+    // cannot see, a nested child has ended by now so only the list of
+    // children of the window shows it, replaying without it would drop it
+    if (draw_list != this->draw_list || draw_list->_Splitter._Count > 1
+        || window->DC.ChildWindows.Size != this->child_windows) {
+        return false;
+    }
+    const ImVec2 size(window->DC.CursorMaxPos.x - this->origin.x,
+                      window->DC.CursorMaxPos.y - this->origin.y);
+
+    // text is culled on the cpu against the clip rect, a partially visible
+    // subtree would be replayed with lines missing after scrolling
+    const ImVec2 clip_min = draw_list->GetClipRectMin();
+    const ImVec2 clip_max = draw_list->GetClipRectMax();
+    if (this->origin.x < clip_min.x || this->origin.y < clip_min.y
+        || this->origin.x + size.x > clip_max.x || this->origin.y + size.y > clip_max.y) {
+        return false;
+    }
+
+    const ImDrawCmd *state = nullptr;
+    Segment         *segment{nullptr};
+    unsigned int     segment_offset = 0;
+    for (int i = this->cmd_start; i < draw_list->CmdBuffer.Size; ++i) {
+        const ImDrawCmd &cmd       = draw_list->CmdBuffer[i];
+        const int        idx_begin = std::max<int>(cmd.IdxOffset, this->idx_start);
+        const int        idx_end   = cmd.IdxOffset + cmd.ElemCount;
+        if (idx_end <= idx_begin) {
+            continue;
+        }
+
+        // everything has to be replayable into a single command state
+        if (cmd.UserCallback != nullptr) {
+            return false;
+        }
+        if (state == nullptr) {
+            state = &cmd;
+        } else if (cmd.TextureId != state->TextureId
+                   || std::memcmp(&cmd.ClipRect, &state->ClipRect, sizeof(ImVec4)) != 0) {
+            return false;
+        }
+
+        if (segment == nullptr || cmd.VtxOffset != segment_offset) {
+            const uint32_t vtx_begin = std::max<int>(cmd.VtxOffset, this->vtx_start);
+            if (segment != nullptr) {
+                segment->vtx_count = vtx_begin - this->vtx_start - segment->vtx_begin;
+            }
+            this->segments.push_back(Segment{vtx_begin - this->vtx_start, 0,
+                                             static_cast<uint32_t>(this->indices.size()), 0});
+            segment        = &this->segments.back();
+            segment_offset = cmd.VtxOffset;
+        }
+
+        const uint32_t base = this->vtx_start + segment->vtx_begin;
+        for (int idx = idx_begin; idx < idx_end; ++idx) {
+            const uint32_t vertex = draw_list->IdxBuffer[idx] + cmd.VtxOffset;
+            if (vertex < base) {
+                this->clear();
+                return false;
+            }
+            this->indices.push_back(static_cast<ImDrawIdx>(vertex - base));
+        }
+        segment->idx_count += idx_end - idx_begin;
+    }
+
+    if (segment == nullptr) {
+        return false;
+    }
+    segment->vtx_count = draw_list->VtxBuffer.Size - this->vtx_start - segment->vtx_begin;
+
+    this->vertices.assign(draw_list->VtxBuffer.Data + this->vtx_start,
+                          draw_list->VtxBuffer.Data + draw_list->VtxBuffer.Size);
+    for (auto &vertex : this->vertices) {
+        vertex.pos.x -= this->origin.x;
+        vertex.pos.y -= this->origin.y;
+    }
+
+    this->texture       = state->TextureId;
+    this->capture_width = this->width;
+    this->size          = size;
+    this->revision      = revision;
+    this->captured      = true;
+    return true;
+}
+
+bool DrawCache::valid(uint32_t revision) const {
+    if (!this->captured || this->revision != revision) {
+        return false;
+    }
+    // a different available width means the layout may have changed
+    if (this->capture_width != ImGui::GetContentRegionAvail().x) {
+        return false;
+    }
+    return ImGui::GetWindowDrawList()->_CmdHeader.TextureId == this->texture;
+}
+
+void DrawCache::replay() const {
+    ImDrawList  *draw_list = ImGui::GetWindowDrawList();
+    const ImVec2 offset    = ImGui::GetCursorScreenPos();
+
+    for (const auto &segment : this->segments) {
+        // may start a new command with a fresh vertex offset
+        draw_list->PrimReserve(segment.idx_count, segment.vtx_count);
+        const uint32_t base = draw_list->_VtxCurrentIdx;
+
+        const ImDrawVert *vertex = this->vertices.data() + segment.vtx_begin;
+        for (uint32_t i = 0; i < segment.vtx_count; ++i, ++vertex) {
+            ImDrawVert *out = draw_list->_VtxWritePtr++;
+            out->pos        = ImVec2(vertex->pos.x + offset.x, vertex->pos.y + offset.y);
+            out->uv         = vertex->uv;
+            out->col        = vertex->col;
+        }
+
+        const ImDrawIdx *index = this->indices.data() + segment.idx_begin;
+        for (uint32_t i = 0; i < segment.idx_count; ++i) {
+            *draw_list->_IdxWritePtr++ = static_cast<ImDrawIdx>(base + index[i]);
+        }
+        draw_list->_VtxCurrentIdx += segment.vtx_count;
+    }
+}
+
+void DrawCache::clear() noexcept {
+    this->captured = false;
+    this->vertices.clear();
+    this->indices.clear();
+    this->segments.clear();
+}
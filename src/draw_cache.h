@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <imgui.h>
+#include <vector>
+
+// geometry emitted into the draw list of a child window by its static
+// contents, captured once and replayed with a translation until the contents
+// are invalidated
+class DrawCache {
+public:
+    DrawCache()  = default;
+    ~DrawCache() = default;
+
+    // start recording everything emitted into the current window draw list
+    void begin_capture();
+
+    // stop recording, the geometry is only kept when the contents stayed
+    // inside a single draw command state, opened no child window of their own
+    // and were not clipped
+    bool end_capture(uint32_t revision);
+
+    // true when the captured geometry still matches the subtree at the given
+    // revision and can be replayed into the current window
+    bool valid(uint32_t revision) const;
+
+    // append the captured geometry at the current cursor position
+    void replay() const;
+
+    // extent of the captured contents from the cursor they started at, a
+    // replay has to submit it for the window to keep its content size
+    const ImVec2 &get_size() const noexcept {
+        return this->size;
+    }
+
+    void clear() noexcept;
+
+private:
+    // run of vertices sharing one vertex offset, indices are relative to the
+    // first vertex of the run
+    struct Segment {
+        uint32_t vtx_begin;
+        uint32_t vtx_count;
+        uint32_t idx_begin;
+        uint32_t idx_count;
+    };
+
+    // capture state
+    ImDrawList *draw_list{nullptr};
+    int         child_windows{0};
+    int         cmd_start{0};
+    int         vtx_start{0};
+    int         idx_start{0};
+    ImVec2      origin{0.0f, 0.0f};
+    float       width{0.0f};
+
+    // captured geometry, positions relative to the origin
+    bool                    captured{false};
+    uint32_t                revision{0};
+    ImTextureID             texture{};
+    float                   capture_width{0.0f};
+    ImVec2                  size{0.0f, 0.0f};
+    std::vector<ImDrawVert> vertices;
+    std::vector<ImDrawIdx>  indices;
+    std::vector<Segment>    segments;
+};
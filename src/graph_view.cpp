@@ -0,0 +1,485 @@
+#include "graph_view.h"
+
+#include <algorithm>
+#include <boost/graph/fruchterman_reingold.hpp>
+#include <boost/graph/random_layout.hpp>
+#include <boost/graph/topology.hpp>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+using Topology = boost::square_topology<>;
+using Point    = Topology::point_type;
+
+// screen size a grid cell needs before its nodes are drawn individually
+constexpr float lod_pixels = 24.0f;
+// coarsest level is reduced to about this many cells per side
+constexpr int max_cells = 64;
+
+constexpr auto publish_interval = std::chrono::milliseconds(33);
+
+// repulsion between nodes closer than 2k, bucketed on a grid over the
+// topology so an iteration stays linear in the number of nodes, the stock
+// boost::grid_force_pairs assumes a centered topology and sizes its cells
+// from the area instead of its square root, degrading to all pairs here
+class GridForcePairs {
+public:
+    GridForcePairs(const std::vector<Point> &points, double side, size_t count) :
+        points(&points), side(side),
+        two_k(2.0 * side / std::sqrt(static_cast<double>(std::max<size_t>(count, 1)))) {
+        this->columns = static_cast<size_t>(side / this->two_k) + 1;
+    }
+
+    template <typename Graph, typename ApplyForce>
+    void operator()(const Graph &graph, ApplyForce apply_force) {
+        const auto  &points = *this->points;
+        const size_t count  = boost::num_vertices(graph);
+        const size_t cells  = this->columns * this->columns;
+
+        // counting sort of the nodes into their buckets
+        this->cell.resize(count);
+        this->start.assign(cells + 1, 0);
+        for (size_t v = 0; v < count; ++v) {
+            this->cell[v] = this->cell_of(points[v][1]) * this->columns
+                            + this->cell_of(points[v][0]);
+            ++this->start[this->cell[v] + 1];
+        }
+        for (size_t c = 0; c < cells; ++c) {
+            this->start[c + 1] += this->start[c];
+        }
+        this->fill.assign(this->start.begin(), this->start.end() - 1);
+        this->nodes.resize(count);
+        for (size_t v = 0; v < count; ++v) {
+            this->nodes[this->fill[this->cell[v]]++] = v;
+        }
+
+        for (size_t row = 0; row < this->columns; ++row) {
+            for (size_t column = 0; column < this->columns; ++column) {
+                const size_t c = row * this->columns + column;
+                for (size_t i = this->start[c]; i < this->start[c + 1]; ++i) {
+                    const size_t u = this->nodes[i];
+                    for (size_t other_row = row == 0 ? 0 : row - 1;
+                         other_row <= std::min(row + 1, this->columns - 1); ++other_row) {
+                        for (size_t other_column = column == 0 ? 0 : column - 1;
+                             other_column <= std::min(column + 1, this->columns - 1);
+                             ++other_column) {
+                            const size_t o = other_row * this->columns + other_column;
+                            for (size_t j = this->start[o]; j < this->start[o + 1]; ++j) {
+                                const size_t v  = this->nodes[j];
+                                const double dx = points[u][0] - points[v][0];
+                                const double dy = points[u][1] - points[v][1];
+                                if (u != v && dx * dx + dy * dy < this->two_k * this->two_k) {
+                                    apply_force(u, v);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    size_t cell_of(double x) const {
+        return std::min(static_cast<size_t>(std::max(x, 0.0) / this->two_k), this->columns - 1);
+    }
+
+    const std::vector<Point> *points;
+    double                    side;
+    double                    two_k;
+    size_t                    columns;
+
+    std::vector<size_t> cell;
+    std::vector<size_t> start;
+    std::vector<size_t> fill;
+    std::vector<size_t> nodes;
+};
+
+// copies the positions out of the layout before every iteration and stops
+// the layout once it cooled down or a new graph replaced it
+class Cooling {
+public:
+    Cooling(std::function<void()> publish, const std::stop_token &stop, double temp,
+            double min_temp) :
+        publish(std::move(publish)),
+        stop(&stop), temp(temp), min_temp(min_temp) {
+    }
+
+    double operator()() {
+        if (this->stop->stop_requested()) {
+            return 0.0;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - this->last_publish >= publish_interval) {
+            this->publish();
+            this->last_publish = now;
+        }
+
+        if (this->temp < this->min_temp) {
+            this->publish();
+            return 0.0;
+        }
+        const double temp = this->temp;
+        this->temp *= 0.98;
+        return temp;
+    }
+
+private:
+    std::function<void()>                 publish;
+    const std::stop_token                *stop;
+    double                                temp;
+    double                                min_temp;
+    std::chrono::steady_clock::time_point last_publish{};
+};
+
+} // namespace
+
+int GraphView::Level::cell_of(const ImVec2 &origin, const ImVec2 &pos) const {
+    const int x = static_cast<int>((pos.x - origin.x) / this->cell);
+    const int y = static_cast<int>((pos.y - origin.y) / this->cell);
+    return std::clamp(y, 0, this->rows - 1) * this->columns + std::clamp(x, 0, this->columns - 1);
+}
+
+GraphView::GraphView(const std::string &name) : Widget(name) {
+}
+
+GraphView::~GraphView() = default;
+
+void GraphView::set_graph(Graph graph) {
+    std::erase_if(this->stopping, [](const auto &previous) {
+        return previous.second->finished.load(std::memory_order_acquire);
+    });
+    if (this->layout.joinable()) {
+        this->layout.request_stop();
+        this->stopping.emplace_back(std::move(this->layout), std::move(this->state));
+    }
+
+    this->graph  = std::make_shared<const Graph>(std::move(graph));
+    this->state  = std::make_shared<Layout>();
+    this->fit    = true;
+    this->layout = std::jthread([graph = this->graph, state = this->state](std::stop_token stop) {
+        layout_loop(stop, *graph, *state);
+        state->finished.store(true, std::memory_order_release);
+    });
+}
+
+void GraphView::layout_loop(std::stop_token stop, const Graph &graph, Layout &layout) {
+    const size_t count = boost::num_vertices(graph);
+    if (count == 0) {
+        return;
+    }
+
+    const double       side = 10.0 * std::sqrt(static_cast<double>(count));
+    boost::minstd_rand generator;
+    Topology           topology(generator, side);
+
+    std::vector<Point> points(count);
+    auto position = boost::make_iterator_property_map(points.begin(),
+                                                      boost::get(boost::vertex_index, graph));
+    boost::random_graph_layout(graph, position, topology);
+
+    std::vector<ImVec2> positions;
+    auto                publish = [&] {
+        positions.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            positions[i]
+                = ImVec2(static_cast<float>(points[i][0]), static_cast<float>(points[i][1]));
+        }
+        auto next = build_snapshot(graph, std::move(positions));
+
+        std::lock_guard<std::mutex> lock(layout.mutex);
+        layout.snapshot = std::move(next);
+    };
+
+    boost::fruchterman_reingold_force_directed_layout(
+        graph, position, topology,
+        boost::force_pairs(GridForcePairs(points, side, count))
+            .cooling(Cooling(publish, stop, side / 10.0, side / 1e4)));
+}
+
+std::shared_ptr<const GraphView::Snapshot>
+    GraphView::build_snapshot(const Graph &graph, std::vector<ImVec2> positions) {
+    auto snapshot       = std::make_shared<Snapshot>();
+    snapshot->positions = std::move(positions);
+
+    const auto &pos = snapshot->positions;
+    ImVec2      min = pos[0];
+    ImVec2      max = pos[0];
+    for (const auto &p : pos) {
+        min = ImVec2(std::min(min.x, p.x), std::min(min.y, p.y));
+        max = ImVec2(std::max(max.x, p.x), std::max(max.y, p.y));
+    }
+    snapshot->min = min;
+    snapshot->max = max;
+
+    // level 0 holds about two nodes per cell
+    const float width  = std::max(max.x - min.x, 1.0f);
+    const float height = std::max(max.y - min.y, 1.0f);
+    float       cell   = std::sqrt(width * height / std::max<size_t>(pos.size() / 2, 1));
+
+    std::vector<uint32_t> node_cell(pos.size());
+    std::vector<uint32_t> previous_cell;
+    for (;;) {
+        Level level;
+        level.cell    = cell;
+        level.columns = static_cast<int>(std::ceil(width / cell)) + 1;
+        level.rows    = static_cast<int>(std::ceil(height / cell)) + 1;
+        const size_t cells = static_cast<size_t>(level.columns) * level.rows;
+
+        for (size_t i = 0; i < pos.size(); ++i) {
+            node_cell[i] = level.cell_of(min, pos[i]);
+        }
+
+        if (snapshot->levels.empty()) {
+            // counting sort of the nodes by cell
+            level.start.assign(cells + 1, 0);
+            for (uint32_t c : node_cell) {
+                ++level.start[c + 1];
+            }
+            for (size_t c = 0; c < cells; ++c) {
+                level.start[c + 1] += level.start[c];
+            }
+            level.nodes.resize(pos.size());
+            std::vector<uint32_t> fill(level.start.begin(), level.start.end() - 1);
+            for (uint32_t i = 0; i < pos.size(); ++i) {
+                level.nodes[fill[node_cell[i]]++] = i;
+            }
+        } else {
+            level.centroid.assign(cells, ImVec2(0.0f, 0.0f));
+            level.count.assign(cells, 0);
+            for (size_t i = 0; i < pos.size(); ++i) {
+                level.centroid[node_cell[i]].x += pos[i].x;
+                level.centroid[node_cell[i]].y += pos[i].y;
+                ++level.count[node_cell[i]];
+            }
+            for (size_t c = 0; c < cells; ++c) {
+                if (level.count[c] > 0) {
+                    level.centroid[c].x /= level.count[c];
+                    level.centroid[c].y /= level.count[c];
+                }
+            }
+
+            // merge the edges between each pair of cells, stored in both
+            // directions so either end can find the link
+            std::vector<uint64_t> keys;
+            keys.reserve(2 * boost::num_edges(graph));
+            for (auto [e, end] = boost::edges(graph); e != end; ++e) {
+                const uint64_t a = node_cell[boost::source(*e, graph)];
+                const uint64_t b = node_cell[boost::target(*e, graph)];
+                if (a != b) {
+                    keys.push_back(a << 32 | b);
+                    keys.push_back(b << 32 | a);
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+
+            level.link_start.assign(cells + 1, 0);
+            for (size_t i = 0; i < keys.size();) {
+                size_t j = i;
+                while (j < keys.size() && keys[j] == keys[i]) {
+                    ++j;
+                }
+                const uint32_t a = static_cast<uint32_t>(keys[i] >> 32);
+                level.links.emplace_back(static_cast<uint32_t>(keys[i]),
+                                         static_cast<uint32_t>(j - i));
+                ++level.link_start[a + 1];
+                i = j;
+            }
+            for (size_t c = 0; c < cells; ++c) {
+                level.link_start[c + 1] += level.link_start[c];
+            }
+        }
+
+        snapshot->levels.push_back(std::move(level));
+        if (std::max(snapshot->levels.back().columns, snapshot->levels.back().rows) <= max_cells) {
+            break;
+        }
+        cell *= 2.0f;
+    }
+
+    return snapshot;
+}
+
+void GraphView::render() {
+    ImGui::PushID(this->name.c_str());
+    ImGui::BeginChild("graph", ImVec2(0, 0), true,
+                      ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+
+    this->canvas_origin = ImGui::GetCursorScreenPos();
+    this->canvas_size   = ImGui::GetContentRegionAvail();
+    this->canvas_size.x = std::max(this->canvas_size.x, 1.0f);
+    this->canvas_size.y = std::max(this->canvas_size.y, 1.0f);
+    ImGui::InvisibleButton("canvas", this->canvas_size);
+
+    const auto snapshot = this->get_snapshot();
+    if (snapshot) {
+        ImGuiIO &io = ImGui::GetIO();
+        if (this->fit) {
+            this->center = ImVec2((snapshot->min.x + snapshot->max.x) * 0.5f,
+                                  (snapshot->min.y + snapshot->max.y) * 0.5f);
+            const ImVec2 extent(snapshot->max.x - snapshot->min.x + 1.0f,
+                                snapshot->max.y - snapshot->min.y + 1.0f);
+            this->zoom = std::min(this->canvas_size.x / extent.x, this->canvas_size.y / extent.y);
+            this->fit  = false;
+        }
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+            this->center.x -= io.MouseDelta.x / this->zoom;
+            this->center.y -= io.MouseDelta.y / this->zoom;
+        }
+        if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+            // zoom around the world position under the mouse
+            const ImVec2 mouse(this->center.x + (io.MousePos.x - this->canvas_origin.x
+                                                 - this->canvas_size.x * 0.5f) / this->zoom,
+                               this->center.y + (io.MousePos.y - this->canvas_origin.y
+                                                 - this->canvas_size.y * 0.5f) / this->zoom);
+            const float  scale = std::pow(1.2f, io.MouseWheel);
+            this->zoom *= scale;
+            this->center.x = mouse.x + (this->center.x - mouse.x) / scale;
+            this->center.y = mouse.y + (this->center.y - mouse.y) / scale;
+        }
+
+        const ImVec2 half(this->canvas_size.x * 0.5f / this->zoom,
+                          this->canvas_size.y * 0.5f / this->zoom);
+        const ImVec2 min(this->center.x - half.x, this->center.y - half.y);
+        const ImVec2 max(this->center.x + half.x, this->center.y + half.y);
+
+        ImDrawList *draw_list = ImGui::GetWindowDrawList();
+        draw_list->PushClipRect(this->canvas_origin,
+                                ImVec2(this->canvas_origin.x + this->canvas_size.x,
+                                       this->canvas_origin.y + this->canvas_size.y),
+                                true);
+
+        // the finest level whose cells are still large enough on screen
+        size_t level = 0;
+        while (level + 1 < snapshot->levels.size()
+               && snapshot->levels[level].cell * this->zoom < lod_pixels) {
+            ++level;
+        }
+        if (level == 0) {
+            this->draw_nodes(draw_list, *snapshot, min, max);
+        } else {
+            this->draw_clusters(draw_list, *snapshot, snapshot->levels[level], min, max);
+        }
+
+        draw_list->PopClipRect();
+    }
+
+    ImGui::EndChild();
+    ImGui::PopID();
+}
+
+void GraphView::draw_nodes(ImDrawList *draw_list, const Snapshot &snapshot, const ImVec2 &min,
+                           const ImVec2 &max) const {
+    const Level &level     = snapshot.levels[0];
+    const auto  &pos       = snapshot.positions;
+    const int    first     = level.cell_of(snapshot.min, min);
+    const int    last      = level.cell_of(snapshot.min, max);
+    const int    min_x     = first % level.columns;
+    const int    max_x     = last % level.columns;
+    const int    min_y     = first / level.columns;
+    const int    max_y     = last / level.columns;
+    const float  radius    = std::clamp(level.cell * this->zoom * 0.1f, 2.0f, 8.0f);
+    const ImU32  node_col  = IM_COL32(255, 200, 80, 255);
+    const ImU32  edge_col  = IM_COL32(200, 200, 200, 96);
+    auto         is_inside = [&](const ImVec2 &p) {
+        const int cell = level.cell_of(snapshot.min, p);
+        const int x    = cell % level.columns;
+        const int y    = cell / level.columns;
+        return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+    };
+
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            const int cell = y * level.columns + x;
+            for (uint32_t i = level.start[cell]; i < level.start[cell + 1]; ++i) {
+                const uint32_t node = level.nodes[i];
+                const ImVec2   from = this->to_screen(pos[node]);
+
+                // every edge is drawn once, by its source unless the source
+                // lies in a cell that is not visited
+                for (auto [e, end] = boost::out_edges(node, *this->graph); e != end; ++e) {
+                    draw_list->AddLine(from, this->to_screen(pos[boost::target(*e, *this->graph)]),
+                                       edge_col);
+                }
+                for (auto [e, end] = boost::in_edges(node, *this->graph); e != end; ++e) {
+                    const ImVec2 &source = pos[boost::source(*e, *this->graph)];
+                    if (!is_inside(source)) {
+                        draw_list->AddLine(this->to_screen(source), from, edge_col);
+                    }
+                }
+            }
+        }
+    }
+
+    // nodes on top of the edges
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            const int cell = y * level.columns + x;
+            for (uint32_t i = level.start[cell]; i < level.start[cell + 1]; ++i) {
+                draw_list->AddCircleFilled(this->to_screen(pos[level.nodes[i]]), radius, node_col);
+            }
+        }
+    }
+}
+
+void GraphView::draw_clusters(ImDrawList *draw_list, const Snapshot &snapshot, const Level &level,
+                              const ImVec2 &min, const ImVec2 &max) const {
+    const int   first       = level.cell_of(snapshot.min, min);
+    const int   last        = level.cell_of(snapshot.min, max);
+    const int   min_x       = first % level.columns;
+    const int   max_x       = last % level.columns;
+    const int   min_y       = first / level.columns;
+    const int   max_y       = last / level.columns;
+    const ImU32 cluster_col = IM_COL32(255, 160, 60, 255);
+    const ImU32 link_col    = IM_COL32(200, 200, 200, 96);
+    auto        is_inside   = [&](uint32_t cell) {
+        const int x = static_cast<int>(cell) % level.columns;
+        const int y = static_cast<int>(cell) / level.columns;
+        return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+    };
+
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            const uint32_t cell = y * level.columns + x;
+            const ImVec2   from = this->to_screen(level.centroid[cell]);
+            for (uint32_t i = level.link_start[cell]; i < level.link_start[cell + 1]; ++i) {
+                const auto [other, count] = level.links[i];
+                if (is_inside(other) && other < cell) {
+                    continue;
+                }
+                draw_list->AddLine(from, this->to_screen(level.centroid[other]), link_col,
+                                   1.0f + 0.5f * std::log2(static_cast<float>(count)));
+            }
+        }
+    }
+
+    const float max_radius = level.cell * this->zoom * 0.45f;
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            const uint32_t cell = y * level.columns + x;
+            if (level.count[cell] == 0) {
+                continue;
+            }
+            const float radius
+                = std::min(max_radius, 2.0f + std::sqrt(static_cast<float>(level.count[cell])));
+            draw_list->AddCircleFilled(this->to_screen(level.centroid[cell]), radius, cluster_col);
+        }
+    }
+}
+
+ImVec2 GraphView::to_screen(const ImVec2 &pos) const {
+    return ImVec2(this->canvas_origin.x + this->canvas_size.x * 0.5f
+                      + (pos.x - this->center.x) * this->zoom,
+                  this->canvas_origin.y + this->canvas_size.y * 0.5f
+                      + (pos.y - this->center.y) * this->zoom);
+}
+
+std::shared_ptr<const GraphView::Snapshot> GraphView::get_snapshot() const {
+    if (!this->state) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    return this->state->snapshot;
+}
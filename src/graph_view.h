@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <boost/graph/adjacency_list.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "widget.h"
+
+// node graph viewer for large dependency graphs, the layout converges on a
+// worker thread while the view pans and zooms over the latest snapshot
+class GraphView : public Widget {
+public:
+    using Graph = boost::adjacency_list<boost::vecS, boost::vecS, boost::bidirectionalS>;
+
+    GraphView(const std::string &name);
+    virtual ~GraphView();
+
+    virtual void render() override;
+
+    // take the graph and restart the layout from random positions, the
+    // previous layout is stopped without waiting for it
+    void set_graph(Graph graph);
+
+private:
+    // uniform grid over the layout, level 0 indexes the nodes themselves and
+    // every coarser level doubles the cell size and aggregates the level below
+    struct Level {
+        float cell;
+        int   columns;
+        int   rows;
+
+        // nodes of each cell, level 0 only
+        std::vector<uint32_t> start;
+        std::vector<uint32_t> nodes;
+
+        // clusters and merged edges between them, coarser levels only
+        std::vector<ImVec2>                        centroid;
+        std::vector<uint32_t>                      count;
+        std::vector<uint32_t>                      link_start;
+        std::vector<std::pair<uint32_t, uint32_t>> links;
+
+        int cell_of(const ImVec2 &origin, const ImVec2 &pos) const;
+    };
+
+    struct Snapshot {
+        std::vector<ImVec2> positions;
+        ImVec2              min;
+        ImVec2              max;
+        std::vector<Level>  levels;
+    };
+
+    // what one layout thread publishes, shared so a replaced layout can wind
+    // down on its own without touching the view
+    struct Layout {
+        std::mutex                      mutex;
+        std::shared_ptr<const Snapshot> snapshot;
+        std::atomic<bool>               finished{false};
+    };
+
+    static void layout_loop(std::stop_token stop, const Graph &graph, Layout &layout);
+
+    static std::shared_ptr<const Snapshot> build_snapshot(const Graph &graph,
+                                                          std::vector<ImVec2> positions);
+
+    void draw_nodes(ImDrawList *draw_list, const Snapshot &snapshot, const ImVec2 &min,
+                    const ImVec2 &max) const;
+
+    void draw_clusters(ImDrawList *draw_list, const Snapshot &snapshot, const Level &level,
+                       const ImVec2 &min, const ImVec2 &max) const;
+
+    ImVec2 to_screen(const ImVec2 &pos) const;
+
+    std::shared_ptr<const Snapshot> get_snapshot() const;
+
+    std::shared_ptr<const Graph> graph;
+    std::shared_ptr<Layout>      state;
+
+    // view transform, world position at the center of the canvas and pixels
+    // per world unit
+    ImVec2 center{0.0f, 0.0f};
+    float  zoom{1.0f};
+    bool   fit{true};
+    ImVec2 canvas_origin{0.0f, 0.0f};
+    ImVec2 canvas_size{0.0f, 0.0f};
+
+    std::jthread layout;
+
+    // replaced layouts that were asked to stop, joined once they finished so
+    // the UI thread never waits for an iteration in progress
+    std::vector<std::pair<std::jthread, std::shared_ptr<Layout>>> stopping;
+};
@@ -0,0 +1,36 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LatencyHistogram::add(double seconds) noexcept {
+    seconds = std::max(seconds, 0.0);
+
+    const double bucket = std::floor(seconds / bucket_seconds);
+    if (bucket < static_cast<double>(bucket_count)) {
+        ++this->buckets[static_cast<size_t>(bucket)];
+    } else {
+        ++this->overflow;
+    }
+    ++this->count;
+    this->sum += seconds;
+    this->max = std::max(this->max, seconds);
+}
+
+double LatencyHistogram::percentile(double fraction) const noexcept {
+    if (this->count == 0) {
+        return 0.0;
+    }
+
+    // rank of the sample, counted from one
+    const auto rank = std::max<uint64_t>(
+        static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * this->count)), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += this->buckets[i];
+        if (seen >= rank) {
+            return std::min(static_cast<double>(i + 1) * bucket_seconds, this->max);
+        }
+    }
+    return this->max;
+}
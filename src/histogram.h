@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// distribution of latencies in fixed buckets of half a millisecond, anything
+// above the last bucket is only counted and kept as the maximum
+class LatencyHistogram {
+public:
+    static constexpr double bucket_seconds = 0.0005;
+    static constexpr size_t bucket_count   = 200;
+
+    LatencyHistogram()  = default;
+    ~LatencyHistogram() = default;
+
+    void add(double seconds) noexcept;
+
+    void reset() noexcept {
+        *this = LatencyHistogram();
+    }
+
+    uint64_t get_count() const noexcept {
+        return this->count;
+    }
+
+    double get_max() const noexcept {
+        return this->max;
+    }
+
+    double get_mean() const noexcept {
+        return this->count ? this->sum / static_cast<double>(this->count) : 0.0;
+    }
+
+    // upper edge of the bucket the given fraction of samples falls into, the
+    // maximum once it is past the last bucket
+    double percentile(double fraction) const noexcept;
+
+    const std::array<uint64_t, bucket_count> &get_buckets() const noexcept {
+        return this->buckets;
+    }
+
+    uint64_t get_overflow() const noexcept {
+        return this->overflow;
+    }
+
+private:
+    std::array<uint64_t, bucket_count> buckets{};
+    uint64_t                           overflow{0};
+    uint64_t                           count{0};
+    double                             sum{0.0};
+    double                             max{0.0};
+};
@@ -52,9 +52,11 @@ static VkDebugReportCallbackEXT g_DebugReport    = VK_NULL_HANDLE;
 static VkPipelineCache          g_PipelineCache  = VK_NULL_HANDLE;
 static VkDescriptorPool         g_DescriptorPool = VK_NULL_HANDLE;
 
-static ImGui_ImplVulkanH_Window g_MainWindowData;
-static int                      g_MinImageCount    = 2;
-static bool                     g_SwapChainRebuild = false;
+static int g_MinImageCount = 2;
+
+// VK_KHR_present_wait with VK_KHR_present_id, when the device has both
+static bool                    g_PresentWait       = false;
+static PFN_vkWaitForPresentKHR g_WaitForPresentKHR = NULL;
 
 static void glfw_error_callback(int error, const char *description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
@@ -67,6 +69,19 @@ static void check_vk_result(VkResult err) {
         abort();
 }
 
+static bool IsDeviceExtensionAvailable(VkPhysicalDevice physical_device, const char *extension) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &count, NULL);
+    VkExtensionProperties *properties
+        = (VkExtensionProperties *) malloc(sizeof(VkExtensionProperties) * count);
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &count, properties);
+    bool available = false;
+    for (uint32_t i = 0; i < count && !available; i++)
+        available = strcmp(properties[i].extensionName, extension) == 0;
+    free(properties);
+    return available;
+}
+
 #ifdef IMGUI_VULKAN_DEBUG_REPORT
 static VKAPI_ATTR VkBool32 VKAPI_CALL debug_report(VkDebugReportFlagsEXT      flags,
                                                    VkDebugReportObjectTypeEXT objectType,
@@ -88,10 +103,14 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_report(VkDebugReportFlagsEXT      fl
 static void SetupVulkan(const char **extensions, uint32_t extensions_count) {
     VkResult err;
 
-    // Create Vulkan Instance
+    // Create Vulkan Instance, 1.1 to query the present wait features
     {
+        VkApplicationInfo app_info          = {};
+        app_info.sType                      = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        app_info.apiVersion                 = VK_API_VERSION_1_1;
         VkInstanceCreateInfo create_info    = {};
         create_info.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        create_info.pApplicationInfo        = &app_info;
         create_info.enabledExtensionCount   = extensions_count;
         create_info.ppEnabledExtensionNames = extensions;
 #ifdef IMGUI_VULKAN_DEBUG_REPORT
@@ -183,10 +202,36 @@ static void SetupVulkan(const char **extensions, uint32_t extensions_count) {
         IM_ASSERT(g_QueueFamily != (uint32_t) -1);
     }
 
+    // Check for present wait, lets the low latency mode sleep until a frame
+    // is actually on screen
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {};
+    present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {};
+    present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    present_wait_features.pNext = &present_id_features;
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(g_PhysicalDevice, &properties);
+        if (properties.apiVersion >= VK_API_VERSION_1_1
+            && IsDeviceExtensionAvailable(g_PhysicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME)
+            && IsDeviceExtensionAvailable(g_PhysicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+            VkPhysicalDeviceFeatures2 features = {};
+            features.sType                     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext                     = &present_wait_features;
+            vkGetPhysicalDeviceFeatures2(g_PhysicalDevice, &features);
+            g_PresentWait = present_id_features.presentId && present_wait_features.presentWait;
+        }
+        // only the two features are enabled through the chain
+        present_id_features.presentId     = VK_TRUE;
+        present_wait_features.presentWait = VK_TRUE;
+    }
+
     // Create Logical Device (with 1 queue)
     {
-        int                     device_extension_count = 1;
-        const char             *device_extensions[]    = {"VK_KHR_swapchain"};
+        int                     device_extension_count = g_PresentWait ? 3 : 1;
+        const char             *device_extensions[]    = {"VK_KHR_swapchain",
+                                                          VK_KHR_PRESENT_ID_EXTENSION_NAME,
+                                                          VK_KHR_PRESENT_WAIT_EXTENSION_NAME};
         const float             queue_priority[]       = {1.0f};
         VkDeviceQueueCreateInfo queue_info[1]          = {};
         queue_info[0].sType                            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -199,9 +244,16 @@ static void SetupVulkan(const char **extensions, uint32_t extensions_count) {
         create_info.pQueueCreateInfos                  = queue_info;
         create_info.enabledExtensionCount              = device_extension_count;
         create_info.ppEnabledExtensionNames            = device_extensions;
+        if (g_PresentWait)
+            create_info.pNext = &present_wait_features;
         err = vkCreateDevice(g_PhysicalDevice, &create_info, g_Allocator, &g_Device);
         check_vk_result(err);
         vkGetDeviceQueue(g_Device, g_QueueFamily, 0, &g_Queue);
+        if (g_PresentWait) {
+            g_WaitForPresentKHR
+                = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(g_Device, "vkWaitForPresentKHR");
+            g_PresentWait = g_WaitForPresentKHR != NULL;
+        }
     }
 
     // Create Descriptor Pool
@@ -284,34 +336,30 @@ static void CleanupVulkan() {
     vkDestroyInstance(g_Instance, g_Allocator);
 }
 
-static void CleanupVulkanWindow() {
-    ImGui_ImplVulkanH_DestroyWindow(g_Instance, g_Device, &g_MainWindowData, g_Allocator);
+static void CleanupVulkanWindow(ImGui_ImplVulkanH_Window *wd) {
+    ImGui_ImplVulkanH_DestroyWindow(g_Instance, g_Device, wd, g_Allocator);
 }
 
-static void FrameRender(ImGui_ImplVulkanH_Window *wd, ImDrawData *draw_data) {
-    VkResult err;
-
+// Acquire the next swapchain image, returns false when the swapchain is out of
+// date and has to be rebuilt
+static bool FrameAcquire(ImGui_ImplVulkanH_Window *wd) {
     VkSemaphore image_acquired_semaphore
         = wd->FrameSemaphores[wd->SemaphoreIndex].ImageAcquiredSemaphore;
-    VkSemaphore render_complete_semaphore
-        = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
-    err = vkAcquireNextImageKHR(g_Device, wd->Swapchain, UINT64_MAX, image_acquired_semaphore,
-                                VK_NULL_HANDLE, &wd->FrameIndex);
+    VkResult err = vkAcquireNextImageKHR(g_Device, wd->Swapchain, UINT64_MAX,
+                                         image_acquired_semaphore, VK_NULL_HANDLE, &wd->FrameIndex);
     if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-        g_SwapChainRebuild = true;
-        return;
+        return false;
     }
     check_vk_result(err);
+    return true;
+}
 
-    ImGui_ImplVulkanH_Frame *fd = &wd->Frames[wd->FrameIndex];
-    {
-        err = vkWaitForFences(g_Device, 1, &fd->Fence, VK_TRUE,
-                              UINT64_MAX); // wait indefinitely instead of periodically checking
-        check_vk_result(err);
+// Record the draw data into the command buffer of the acquired frame, the
+// caller makes sure the GPU is done with it and submits it
+static void FrameRecord(ImGui_ImplVulkanH_Window *wd, ImDrawData *draw_data) {
+    VkResult err;
 
-        err = vkResetFences(g_Device, 1, &fd->Fence);
-        check_vk_result(err);
-    }
+    ImGui_ImplVulkanH_Frame *fd = &wd->Frames[wd->FrameIndex];
     {
         err = vkResetCommandPool(g_Device, fd->CommandPool, 0);
         check_vk_result(err);
@@ -336,45 +384,84 @@ static void FrameRender(ImGui_ImplVulkanH_Window *wd, ImDrawData *draw_data) {
     // Record dear imgui primitives into command buffer
     ImGui_ImplVulkan_RenderDrawData(draw_data, fd->CommandBuffer);
 
-    // Submit command buffer
     vkCmdEndRenderPass(fd->CommandBuffer);
-    {
-        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        VkSubmitInfo         info       = {};
-        info.sType                      = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        info.waitSemaphoreCount         = 1;
-        info.pWaitSemaphores            = &image_acquired_semaphore;
-        info.pWaitDstStageMask          = &wait_stage;
-        info.commandBufferCount         = 1;
-        info.pCommandBuffers            = &fd->CommandBuffer;
-        info.signalSemaphoreCount       = 1;
-        info.pSignalSemaphores          = &render_complete_semaphore;
-
-        err = vkEndCommandBuffer(fd->CommandBuffer);
-        check_vk_result(err);
-        err = vkQueueSubmit(g_Queue, 1, &info, fd->Fence);
-        check_vk_result(err);
-    }
+    err = vkEndCommandBuffer(fd->CommandBuffer);
+    check_vk_result(err);
 }
 
-static void FramePresent(ImGui_ImplVulkanH_Window *wd) {
-    if (g_SwapChainRebuild)
-        return;
-    VkSemaphore render_complete_semaphore
-        = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
+// Describe the submission of a recorded frame, the semaphores order it after
+// the image acquisition and before the present
+static void FrameSubmitInfo(ImGui_ImplVulkanH_Window *wd, VkSubmitInfo *info) {
+    static const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    ImGui_ImplVulkanH_FrameSemaphores *fsd       = &wd->FrameSemaphores[wd->SemaphoreIndex];
+
+    *info                      = {};
+    info->sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info->waitSemaphoreCount   = 1;
+    info->pWaitSemaphores      = &fsd->ImageAcquiredSemaphore;
+    info->pWaitDstStageMask    = &wait_stage;
+    info->commandBufferCount   = 1;
+    info->pCommandBuffers      = &wd->Frames[wd->FrameIndex].CommandBuffer;
+    info->signalSemaphoreCount = 1;
+    info->pSignalSemaphores    = &fsd->RenderCompleteSemaphore;
+}
+
+// Present the frames of several windows at once. semaphores, swapchains,
+// image_indices and results are scratch arrays of count entries owned by the
+// caller so presenting does not allocate, results[i] is
+// VK_ERROR_OUT_OF_DATE_KHR or VK_SUBOPTIMAL_KHR when the swapchain of wds[i]
+// has to be rebuilt. present_ids tags each frame for FrameWaitPresent and is
+// ignored without present wait
+static void FramePresent(ImGui_ImplVulkanH_Window **wds, uint32_t count,
+                         const uint64_t *present_ids, VkSemaphore *semaphores,
+                         VkSwapchainKHR *swapchains, uint32_t *image_indices, VkResult *results) {
+    for (uint32_t i = 0; i < count; i++) {
+        semaphores[i]    = wds[i]->FrameSemaphores[wds[i]->SemaphoreIndex].RenderCompleteSemaphore;
+        swapchains[i]    = wds[i]->Swapchain;
+        image_indices[i] = wds[i]->FrameIndex;
+        results[i]       = VK_SUCCESS;
+    }
+
     VkPresentInfoKHR info   = {};
     info.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    info.waitSemaphoreCount = 1;
-    info.pWaitSemaphores    = &render_complete_semaphore;
-    info.swapchainCount     = 1;
-    info.pSwapchains        = &wd->Swapchain;
-    info.pImageIndices      = &wd->FrameIndex;
-    VkResult err            = vkQueuePresentKHR(g_Queue, &info);
-    if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-        g_SwapChainRebuild = true;
-        return;
+    info.waitSemaphoreCount = count;
+    info.pWaitSemaphores    = semaphores;
+    info.swapchainCount     = count;
+    info.pSwapchains        = swapchains;
+    info.pImageIndices      = image_indices;
+    info.pResults           = results;
+
+    VkPresentIdKHR present_id = {};
+    if (g_PresentWait && present_ids) {
+        present_id.sType          = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        present_id.swapchainCount = count;
+        present_id.pPresentIds    = present_ids;
+        info.pNext                = &present_id;
     }
-    check_vk_result(err);
-    wd->SemaphoreIndex
-        = (wd->SemaphoreIndex + 1) % wd->ImageCount; // Now we can use the next set of semaphores
-}
\ No newline at end of file
+    VkResult err = vkQueuePresentKHR(g_Queue, &info);
+    if (err != VK_ERROR_OUT_OF_DATE_KHR && err != VK_SUBOPTIMAL_KHR) {
+        check_vk_result(err);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (results[i] != VK_ERROR_OUT_OF_DATE_KHR && results[i] != VK_SUBOPTIMAL_KHR) {
+            check_vk_result(results[i]);
+        }
+        // Now we can use the next set of semaphores
+        wds[i]->SemaphoreIndex = (wds[i]->SemaphoreIndex + 1) % wds[i]->ImageCount;
+    }
+}
+
+// Wait until the frame presented with present_id is on screen, returns false
+// when the timeout passed first, only with present wait
+static bool FrameWaitPresent(ImGui_ImplVulkanH_Window *wd, uint64_t present_id, uint64_t timeout) {
+    VkResult err = g_WaitForPresentKHR(g_Device, wd->Swapchain, present_id, timeout);
+    if (err == VK_TIMEOUT) {
+        return false;
+    }
+    // a lost swapchain is rebuilt by the next frame, nothing left to wait for
+    if (err != VK_ERROR_OUT_OF_DATE_KHR && err != VK_SUBOPTIMAL_KHR) {
+        check_vk_result(err);
+    }
+    return true;
+}
@@ -0,0 +1,485 @@
+#include "log_view.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <tbb/parallel_pipeline.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#    include <immintrin.h>
+#endif
+
+namespace {
+
+// bytes indexed before the line count is published, small enough for the
+// first screen to show up right after opening
+constexpr uint64_t index_chunk = 4 << 20;
+// lines handed to one filter task, and the bytes read for it at most, a
+// longer line is a task of its own and only matched on its first bytes
+constexpr uint64_t filter_chunk = 16384;
+constexpr uint64_t filter_bytes = 1 << 20;
+// bytes of a line drawn at most, more than a window can show anyway
+constexpr uint64_t row_bytes = 4096;
+
+constexpr auto poll_interval = std::chrono::milliseconds(100);
+
+// scroll offsets are floats, beyond this many pixels they stop resolving
+// single lines and longer views map this range onto the rows instead
+constexpr float max_scroll_pixels = 1 << 20;
+// rows moved by a notch of the mouse wheel in a mapped view
+constexpr float wheel_rows = 3.0f;
+
+// append the file offset following every '\n' in the size bytes read from
+// offset base to ends
+void scan_newlines(const char *data, uint64_t size, uint64_t base, std::vector<uint64_t> &ends) {
+    const uint64_t end = size;
+    uint64_t       i   = 0;
+#if defined(__AVX2__)
+    const __m256i newline32 = _mm256_set1_epi8('\n');
+    for (; i + 32 <= end; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        uint32_t      mask
+            = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline32)));
+        while (mask != 0) {
+            ends.push_back(base + i + std::countr_zero(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i newline16 = _mm_set1_epi8('\n');
+    for (; i + 16 <= end; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        uint32_t      mask
+            = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline16)));
+        while (mask != 0) {
+            ends.push_back(base + i + std::countr_zero(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        if (data[i] == '\n') {
+            ends.push_back(base + i + 1);
+        }
+    }
+}
+
+} // namespace
+
+LogView::File::~File() {
+    ::close(this->fd);
+}
+
+size_t LogView::File::read(uint64_t offset, char *data, size_t size) const {
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t read = pread(this->fd, data + done, size - done, offset + done);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read <= 0) {
+            break;
+        }
+        done += read;
+    }
+    return done;
+}
+
+LogView::Filter::Filter(std::string pattern, bool regex) :
+    pattern(std::move(pattern)),
+    searcher(this->pattern.data(), this->pattern.data() + this->pattern.size()) {
+    if (regex) {
+        this->regex.emplace(this->pattern, std::regex::ECMAScript | std::regex::optimize);
+    }
+}
+
+bool LogView::Filter::match(const char *begin, const char *end) const {
+    if (this->regex) {
+        return std::regex_search(begin, end, *this->regex);
+    }
+    return std::search(begin, end, this->searcher) != end;
+}
+
+LogView::LogView(const std::string &name) : Widget(name) {
+}
+
+LogView::~LogView() {
+    this->close();
+}
+
+void LogView::render() {
+    ImGui::PushID(this->name.c_str());
+
+    ImGui::SetNextItemWidth(-200.0f);
+    bool changed = ImGui::InputText("##filter", this->filter_input, sizeof(this->filter_input));
+    ImGui::SameLine();
+    changed |= ImGui::Checkbox("regex", &this->filter_regex);
+    ImGui::SameLine();
+    ImGui::Checkbox("follow", &this->follow);
+    if (changed) {
+        this->set_filter(this->filter_input, this->filter_regex);
+    }
+
+    ImGui::BeginChild("log", ImVec2(0, 0), true, ImGuiWindowFlags_HorizontalScrollbar);
+
+    const Snapshot snapshot = this->get_snapshot();
+    const auto    &index    = snapshot.index;
+    const auto    &file     = snapshot.file;
+    const auto    &filter   = snapshot.filter;
+    const uint64_t bytes    = snapshot.bytes;
+    const uint64_t lines    = snapshot.lines;
+
+    if (index && file) {
+        // the unterminated tail is shown unfiltered until its line break
+        // shows up, the filter may have matched lines past this snapshot
+        const uint64_t tail  = lines > 0 ? index->line_ends[lines - 1] : 0;
+        uint64_t       count = lines + (bytes > tail ? 1 : 0);
+        if (filter) {
+            count = filter->count.load(std::memory_order_acquire);
+            if (count > 0 && filter->matches[count - 1] >= lines) {
+                uint64_t low = 0;
+                while (low < count) {
+                    const uint64_t mid = (low + count) / 2;
+                    if (filter->matches[mid] < lines) {
+                        low = mid + 1;
+                    } else {
+                        count = mid;
+                    }
+                }
+            }
+        }
+
+        auto draw_row = [&](uint64_t row) {
+            const uint64_t line = filter ? filter->matches[row] : row;
+            const auto [begin, end] = line < lines ? index->line_range(line)
+                                                   : std::make_pair(tail, bytes);
+            this->row_text.resize(std::min(end - begin, row_bytes));
+            size_t size = file->read(begin, this->row_text.data(), this->row_text.size());
+            if (size > 0 && size == end - begin && this->row_text[size - 1] == '\r') {
+                --size;
+            }
+            ImGui::TextUnformatted(this->row_text.data(), this->row_text.data() + size);
+        };
+
+        const float line_height = ImGui::GetTextLineHeightWithSpacing();
+        if (static_cast<double>(count) * line_height <= max_scroll_pixels) {
+            ImGuiListClipper clipper;
+            clipper.Begin(static_cast<int>(count));
+            while (clipper.Step()) {
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                    draw_row(row);
+                }
+            }
+            clipper.End();
+
+            this->pinned = ImGui::GetScrollY() >= ImGui::GetScrollMaxY();
+            if (this->follow && this->pinned) {
+                ImGui::SetScrollHereY(1.0f);
+            }
+            this->scroll = -1.0f;
+        } else {
+            // the page is drawn where the window is scrolled to now, the
+            // scroll offset set for the next frame follows the first row
+            const float    start = ImGui::GetCursorPosY();
+            const uint64_t page  = std::max<uint64_t>(
+                static_cast<uint64_t>(ImGui::GetContentRegionAvail().y / line_height), 1);
+            const uint64_t first = this->map_scroll(count, page);
+            ImGui::SetCursorPosY(start + ImGui::GetScrollY());
+            for (uint64_t row = first; row < std::min(count, first + page + 1); ++row) {
+                draw_row(row);
+            }
+            ImGui::SetCursorPosY(start + max_scroll_pixels + page * line_height);
+            ImGui::Dummy(ImVec2(0.0f, 0.0f));
+        }
+    }
+
+    ImGui::EndChild();
+    ImGui::PopID();
+}
+
+uint64_t LogView::map_scroll(uint64_t count, uint64_t page) {
+    const uint64_t last    = count > page ? count - page : 0;
+    const float    current = ImGui::GetScrollY();
+    const float    range   = ImGui::GetScrollMaxY();
+
+    if (this->follow && this->pinned) {
+        this->top = last;
+    }
+
+    // the wheel scrolled the window by pixels, which would skip thousands of
+    // rows here, anything else moving the offset was the scrollbar
+    const float notches = ImGui::GetIO().MouseWheel;
+    if (notches != 0.0f && ImGui::IsWindowHovered()) {
+        this->wheel -= notches * wheel_rows;
+        const float rows = std::trunc(this->wheel);
+        this->wheel -= rows;
+        this->top = rows < 0.0f ? this->top - std::min<uint64_t>(this->top, -rows)
+                                : this->top + static_cast<uint64_t>(rows);
+    } else if (std::fabs(current - this->scroll) > 0.5f && range > 0.0f) {
+        this->top = static_cast<uint64_t>(
+            std::llround(static_cast<double>(current) / range * static_cast<double>(last)));
+    }
+
+    this->top    = std::min(this->top, last);
+    this->pinned = this->top == last;
+
+    this->scroll = last > 0 ? std::floor(static_cast<float>(static_cast<double>(this->top)
+                                                            / static_cast<double>(last) * range))
+                            : 0.0f;
+    ImGui::SetScrollY(this->scroll);
+    return this->top;
+}
+
+bool LogView::open(const std::string &path) {
+    this->close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    this->path = path;
+
+    auto file      = std::make_shared<const File>(fd);
+    this->indexer  = std::jthread([this, file](std::stop_token stop) {
+        this->index_loop(stop, file);
+    });
+    this->filterer = std::jthread([this](std::stop_token stop) { this->filter_loop(stop); });
+    return true;
+}
+
+void LogView::close() {
+    // assigning an empty thread requests a stop and joins
+    this->indexer  = std::jthread();
+    this->filterer = std::jthread();
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->index.reset();
+    this->file.reset();
+    this->renew_filter();
+}
+
+bool LogView::set_filter(std::string pattern, bool regex) {
+    std::shared_ptr<Filter> next;
+    if (!pattern.empty()) {
+        try {
+            next = std::make_shared<Filter>(std::move(pattern), regex);
+        } catch (const std::regex_error &) {
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->filter) {
+            this->filter->cancelled.store(true, std::memory_order_relaxed);
+        }
+        this->filter = std::move(next);
+    }
+    this->notify();
+    return true;
+}
+
+void LogView::index_loop(std::stop_token stop, std::shared_ptr<const File> file) {
+    std::vector<char>      buffer(index_chunk);
+    std::vector<uint64_t>  batch;
+    std::shared_ptr<Index> index;
+    uint64_t               offset = 0;
+    uint64_t               lines  = 0;
+
+    // index from the start into a fresh index, readers keep the old one and
+    // its file alive for as long as they use them
+    auto restart = [&] {
+        index  = std::make_shared<Index>();
+        offset = 0;
+        lines  = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->index = index;
+            this->file  = file;
+            this->renew_filter();
+        }
+        this->notify();
+    };
+    restart();
+
+    while (!stop.stop_requested()) {
+        struct stat st;
+        if (fstat(file->fd, &st) != 0) {
+            return;
+        }
+        const uint64_t size = st.st_size;
+
+        if (size < offset) {
+            // truncated in place, index what is left
+            restart();
+            continue;
+        }
+
+        if (size == offset) {
+            // the old file is drained, follow a new one rotated in at the path
+            struct stat current;
+            if (stat(this->path.c_str(), &current) == 0
+                && (current.st_ino != st.st_ino || current.st_dev != st.st_dev)) {
+                const int next = ::open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (next >= 0) {
+                    file = std::make_shared<const File>(next);
+                    restart();
+                    continue;
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(this->wake_mutex);
+            this->wake.wait_for(lock, stop, poll_interval, [] { return false; });
+            continue;
+        }
+
+        while (offset < size && !stop.stop_requested()) {
+            // a short read means the file was truncated, the next stat sees it
+            const size_t read = file->read(offset, buffer.data(),
+                                           std::min<uint64_t>(size - offset, index_chunk));
+            if (read == 0) {
+                break;
+            }
+            batch.clear();
+            scan_newlines(buffer.data(), read, offset, batch);
+            if (!batch.empty()) {
+                index->line_ends.grow_by(batch.begin(), batch.end());
+                lines += batch.size();
+                index->line_count.store(lines, std::memory_order_release);
+            }
+            offset += read;
+            index->indexed_bytes.store(offset, std::memory_order_release);
+            this->notify();
+        }
+    }
+}
+
+void LogView::filter_loop(std::stop_token stop) {
+    while (!stop.stop_requested()) {
+        const uint64_t seen     = this->generation.load(std::memory_order_acquire);
+        const Snapshot snapshot = this->get_snapshot();
+        Filter        *filter   = snapshot.filter.get();
+
+        if (!filter || filter->scanned >= snapshot.lines) {
+            std::unique_lock<std::mutex> lock(this->wake_mutex);
+            this->wake.wait(lock, stop, [&] {
+                return this->generation.load(std::memory_order_acquire) != seen;
+            });
+            continue;
+        }
+
+        this->run_filter(*filter, *snapshot.index, *snapshot.file, snapshot.lines, stop);
+    }
+}
+
+void LogView::run_filter(Filter &filter, const Index &index, const File &file, uint64_t lines,
+                         const std::stop_token &stop) {
+    using Range  = std::pair<uint64_t, uint64_t>;
+    using Result = std::pair<uint64_t, std::vector<uint64_t>>;
+
+    uint64_t next  = filter.scanned;
+    size_t   count = filter.matches.size();
+
+    auto split = [&](tbb::flow_control &fc) -> Range {
+        if (next >= lines || stop.stop_requested()
+            || filter.cancelled.load(std::memory_order_relaxed)) {
+            fc.stop();
+            return {};
+        }
+        // the last line of the chunk that still ends within its byte budget
+        const uint64_t begin = next;
+        const uint64_t start = begin > 0 ? index.line_ends[begin - 1] : 0;
+        uint64_t       low   = begin + 1;
+        uint64_t       high  = std::min(lines, next + filter_chunk);
+        while (low < high) {
+            const uint64_t mid = (low + high + 1) / 2;
+            if (index.line_ends[mid - 1] - start <= filter_bytes) {
+                low = mid;
+            } else {
+                high = mid - 1;
+            }
+        }
+        next = low;
+        return {begin, next};
+    };
+
+    auto scan = [&](const Range &range) -> Result {
+        Result         result{range.second, {}};
+        const uint64_t start = range.first > 0 ? index.line_ends[range.first - 1] : 0;
+        const uint64_t size  = std::min(index.line_ends[range.second - 1] - start, filter_bytes);
+
+        // lines past a short read were truncated away, a fresh filter runs
+        // over the new index the indexer builds for the rest
+        std::vector<char> buffer(size);
+        const uint64_t    read = file.read(start, buffer.data(), size);
+        for (uint64_t line = range.first; line < range.second; ++line) {
+            const auto [begin, end] = index.line_range(line);
+            if (begin - start >= read) {
+                break;
+            }
+            if (filter.match(buffer.data() + (begin - start),
+                             buffer.data() + std::min(end - start, read))) {
+                result.second.push_back(line);
+            }
+        }
+        return result;
+    };
+
+    auto publish = [&](const Result &result) {
+        if (!result.second.empty()) {
+            filter.matches.grow_by(result.second.begin(), result.second.end());
+            count += result.second.size();
+            filter.count.store(count, std::memory_order_release);
+        }
+        filter.scanned = result.first;
+    };
+
+    // chunks are scanned in parallel and their matches appended in file
+    // order, so the view can show them while the rest is still scanned
+    const size_t tokens = 2 * std::max(1u, std::thread::hardware_concurrency());
+    tbb::parallel_pipeline(tokens,
+                           tbb::make_filter<void, Range>(tbb::filter_mode::serial_in_order, split)
+                               & tbb::make_filter<Range, Result>(tbb::filter_mode::parallel, scan)
+                               & tbb::make_filter<Result, void>(tbb::filter_mode::serial_in_order,
+                                                                publish));
+}
+
+std::pair<uint64_t, uint64_t> LogView::Index::line_range(uint64_t line) const {
+    const uint64_t begin = line > 0 ? this->line_ends[line - 1] : 0;
+    return {begin, this->line_ends[line] - 1};
+}
+
+LogView::Snapshot LogView::get_snapshot() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Snapshot                    snapshot{this->index, this->file, this->filter};
+    if (snapshot.index) {
+        // the byte count is loaded first, every line break below it is
+        // already in the index
+        snapshot.bytes = snapshot.index->indexed_bytes.load(std::memory_order_acquire);
+        snapshot.lines = snapshot.index->line_count.load(std::memory_order_acquire);
+    }
+    return snapshot;
+}
+
+void LogView::renew_filter() {
+    if (this->filter) {
+        this->filter->cancelled.store(true, std::memory_order_relaxed);
+        this->filter
+            = std::make_shared<Filter>(this->filter->pattern, this->filter->regex.has_value());
+    }
+}
+
+void LogView::notify() {
+    {
+        std::lock_guard<std::mutex> lock(this->wake_mutex);
+        this->generation.fetch_add(1, std::memory_order_release);
+    }
+    this->wake.notify_all();
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <stop_token>
+#include <string>
+#include <tbb/concurrent_vector.h>
+#include <thread>
+
+#include "widget.h"
+
+// console for multi-GB log files, the line index is built in the background
+// while appends are followed and only the lines on screen or being filtered
+// are read, with pread so a file truncated under the reader only reads short
+class LogView : public Widget {
+public:
+    LogView(const std::string &name);
+    virtual ~LogView();
+
+    virtual void render() override;
+
+    // map the file and start indexing it, returns false if it cannot be read
+    bool open(const std::string &path);
+
+    void close();
+
+    // only show lines containing the pattern, or matching it as an ECMAScript
+    // regex, an empty pattern shows everything and an invalid regex returns
+    // false, matches stream in while the filter runs in the background
+    bool set_filter(std::string pattern, bool regex = false);
+
+    // keep the view scrolled to the end while new lines arrive
+    void set_follow(bool follow) noexcept {
+        this->follow = follow;
+    }
+
+private:
+    // descriptor of one version of the file, readers keep it open across a
+    // rotation for as long as they use it
+    struct File {
+        explicit File(int fd) : fd(fd) {
+        }
+        ~File();
+
+        // read up to size bytes at offset, fewer when the file ends earlier
+        size_t read(uint64_t offset, char *data, size_t size) const;
+
+        const int fd;
+    };
+
+    struct Filter {
+        Filter(std::string pattern, bool regex);
+
+        bool match(const char *begin, const char *end) const;
+
+        const std::string                                      pattern;
+        const std::boyer_moore_horspool_searcher<const char *> searcher;
+        std::optional<std::regex>                              regex;
+
+        // indices of the matching lines in file order
+        tbb::concurrent_vector<uint64_t> matches;
+        std::atomic<size_t>              count{0};
+        uint64_t                         scanned{0};
+        std::atomic<bool>                cancelled{false};
+    };
+
+    // line index of one version of the file, replaced whole when the file is
+    // truncated or rotated so readers never see it shrink
+    struct Index {
+        // begin and end offsets of a terminated line, without the line break
+        std::pair<uint64_t, uint64_t> line_range(uint64_t line) const;
+
+        // offset one past the line break of every terminated line
+        tbb::concurrent_vector<uint64_t> line_ends;
+        std::atomic<uint64_t>            line_count{0};
+        std::atomic<uint64_t>            indexed_bytes{0};
+    };
+
+    // what the readers work on, taken together so the index offsets are
+    // offsets into this file and the filter matches index lines of this index
+    struct Snapshot {
+        std::shared_ptr<const Index> index;
+        std::shared_ptr<const File>  file;
+        std::shared_ptr<Filter>      filter;
+        uint64_t                     bytes{0};
+        uint64_t                     lines{0};
+    };
+
+    void index_loop(std::stop_token stop, std::shared_ptr<const File> file);
+
+    void filter_loop(std::stop_token stop);
+
+    void run_filter(Filter &filter, const Index &index, const File &file, uint64_t lines,
+                    const std::stop_token &stop);
+
+    // first row of a view too long for float scroll offsets, the scrollbar
+    // covers a fixed range mapped onto the rows and the wheel moves by lines
+    uint64_t map_scroll(uint64_t count, uint64_t page);
+
+    Snapshot get_snapshot() const;
+
+    // replace the filter with an empty copy, its matches index lines of an
+    // index that is gone, called with the mutex held
+    void renew_filter();
+
+    // wake the filter thread after new lines or a new filter
+    void notify();
+
+    std::string path;
+    bool        follow{true};
+
+    mutable std::mutex          mutex;
+    std::shared_ptr<Index>      index;
+    std::shared_ptr<const File> file;
+    std::shared_ptr<Filter>     filter;
+
+    std::mutex                  wake_mutex;
+    std::condition_variable_any wake;
+    std::atomic<uint64_t>       generation{0};
+
+    char filter_input[256]{};
+    bool filter_regex{false};
+
+    // text of the row being drawn
+    std::vector<char> row_text;
+
+    // mapped scrolling, the first row shown, the scroll offset set for it and
+    // whether it showed the last page
+    uint64_t top{0};
+    float    scroll{-1.0f};
+    float    wheel{0.0f};
+    bool     pinned{true};
+
+    std::jthread indexer;
+    std::jthread filterer;
+};
@@ -1,6 +1,10 @@
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <memory>
 
 #include <exec/async_scope.hpp>
 #include <exec/repeat_effect_until.hpp>
@@ -12,16 +16,66 @@
 #include <thread>
 
 #include "application.h"
+#include "metric_grid.h"
 #include "widget.h"
 
 namespace ex = stdexec;
 
-int main(int, char **) {
+int main(int argc, char **argv) {
     exec::single_thread_context ctx;
     exec::async_scope           scope;
 
     auto app = Application();
 
+    bool draw_cache = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--allocator") == 0 && i + 1 < argc) {
+            const char *backend = argv[++i];
+            if (std::strcmp(backend, "system") == 0) {
+                app.get_allocator().set_backend(Allocator::Backend::System);
+            } else if (std::strcmp(backend, "tbbmalloc") == 0) {
+                app.get_allocator().set_backend(Allocator::Backend::TbbMalloc);
+            } else if (std::strcmp(backend, "arena") == 0) {
+                app.get_allocator().set_backend(Allocator::Backend::FrameArena);
+            } else {
+                std::cerr << "unknown allocator " << backend << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+            const char *backend = argv[++i];
+            if (std::strcmp(backend, "stock") == 0) {
+                app.set_render_backend(Application::RenderBackend::Stock);
+            } else if (std::strcmp(backend, "intree") == 0) {
+                app.set_render_backend(Application::RenderBackend::InTree);
+            } else {
+                std::cerr << "unknown renderer " << backend << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            if (!app.record_input(argv[++i])) {
+                std::cerr << "cannot write recording " << argv[i] << std::endl;
+                return 1;
+            }
+            app.set_fixed_timestep(1.0f / 60.0f);
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (!app.replay_input(argv[++i])) {
+                std::cerr << "cannot read recording " << argv[i] << std::endl;
+                return 1;
+            }
+            app.set_fixed_timestep(1.0f / 60.0f);
+        } else if (std::strcmp(argv[i], "--no-draw-cache") == 0) {
+            draw_cache = false;
+        } else if (std::strcmp(argv[i], "--low-latency") == 0) {
+            app.set_low_latency(true);
+        } else if (std::strcmp(argv[i], "--timings") == 0 && i + 1 < argc) {
+            if (!app.write_timings(argv[++i])) {
+                std::cerr << "cannot write timings " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+    }
+
     app.init();
 
     auto root = std::make_unique<ApplicationWindow>("root", &app);
@@ -40,20 +94,31 @@ int main(int, char **) {
 
     button->set_text("Click Me");
 
+    // the task below runs on its own thread and hands its results to the ui
+    // through these channels, so a recording can replay them in the same frames
+    enum Channel : uint32_t { ProgressChannel, DoneChannel };
+
+    app.set_update_handler(ProgressChannel, [p = progress.get()](double value) {
+        p->set_progress(static_cast<float>(value));
+    });
+    app.set_update_handler(DoneChannel, [l = label.get()](double) { l->set_text("Done"); });
+
     std::function<void()> callback
         = [&, l = label.get(), b = button.get(), p = progress.get()]() -> void {
         l->set_text("Clicked");
 
         p->set_progress(0.0f);
 
-        auto task = ex::schedule(ctx.get_scheduler()) | ex::then([&] {
-                        auto progress = p->get_progress();
-                        progress += 0.01f;
+        // the sender is copied for every repetition, the count lives outside
+        auto step = std::make_shared<int>(0);
+        auto task = ex::schedule(ctx.get_scheduler()) | ex::then([&app, step] {
                         std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                        p->set_progress(progress);
-                        return progress >= 1.0f;
+                        const float progress = static_cast<float>(++*step) * 0.01f;
+                        app.post_update(ProgressChannel, progress);
+                        return *step >= 100;
                     })
-                    | exec::repeat_effect_until() | ex::then([&] { l->set_text("Done"); });
+                    | exec::repeat_effect_until()
+                    | ex::then([&app] { app.post_update(DoneChannel, 0.0); });
 
         scope.spawn(std::move(task));
     };
@@ -62,13 +127,96 @@ int main(int, char **) {
 
     auto boxes = std::make_unique<Boxes>("boxes");
 
-    boxes->set_size(3);
+    // allocations of the previous frame, a steady state ui should get these
+    // close to zero
+    auto memory = std::make_unique<Label>("memory");
+
+    memory->set_source([&app](std::string &text) {
+        const auto total = app.get_allocator().get_frame_stats().total();
+        char       buffer[128];
+        std::snprintf(buffer, sizeof(buffer), "allocations %llu, %llu bytes, %llu live",
+                      static_cast<unsigned long long>(total.allocations),
+                      static_cast<unsigned long long>(total.bytes),
+                      static_cast<unsigned long long>(total.live));
+        text.assign(buffer);
+    });
+
+    // cost of recording the previous frame, compare --renderer stock and intree
+    auto render = std::make_unique<Label>("render");
+
+    render->set_source([&app](std::string &text) {
+        const auto &stats = app.get_render_stats();
+        char        buffer[128];
+        std::snprintf(buffer, sizeof(buffer), "record %.3f ms, %llu bytes, %u commands, %u draws",
+                      stats.record_seconds * 1000.0,
+                      static_cast<unsigned long long>(stats.upload_bytes), stats.commands,
+                      stats.draw_calls);
+        text.assign(buffer);
+    });
+
+    // input to present latency of all events so far, compare with and without
+    // --low-latency
+    auto latency = std::make_unique<Label>("latency");
+
+    latency->set_source([&app](std::string &text) {
+        const auto &histogram = app.get_input_latency();
+        char        buffer[128];
+        std::snprintf(buffer, sizeof(buffer), "latency p50 %.1f ms, p99 %.1f ms, max %.1f ms (%s)",
+                      histogram.percentile(0.5) * 1000.0, histogram.percentile(0.99) * 1000.0,
+                      histogram.get_max() * 1000.0,
+                      app.has_present_wait() ? "present wait" : "fence, present call");
+        text.assign(buffer);
+    });
+
+    // about a hundred thousand cells redrawn every frame, drifting waves so
+    // the whole grid changes
+    auto metrics = std::make_unique<MetricGrid>("metrics");
+
+    metrics->set_shape(256, 400);
+    metrics->set_cell_size(ImVec2(2.0f, 2.0f));
+    metrics->set_range(-1.0f, 1.0f);
+    metrics->set_source([phase = 0.0f](float *values, uint32_t rows, uint32_t columns) mutable {
+        phase += 0.05f;
+        for (uint32_t row = 0; row < rows; ++row) {
+            const float speed = 0.02f + 0.001f * static_cast<float>(row);
+            for (uint32_t column = 0; column < columns; ++column) {
+                values[row * columns + column] =
+                    std::sin(speed * static_cast<float>(column) + phase * (1.0f + speed));
+            }
+        }
+    });
+
+    boxes->set_size(7);
     boxes->set_widget(0, std::move(label));
     boxes->set_widget(1, std::move(progress));
     boxes->set_widget(2, std::move(button));
+    boxes->set_widget(3, std::move(memory));
+    boxes->set_widget(4, std::move(render));
+    boxes->set_widget(5, std::move(latency));
+    boxes->set_widget(6, std::move(metrics));
 
     dynamic_cast<ApplicationWindow *>(app.get_root())->set_widget(std::move(boxes));
 
+    // a second window of static text, every row of the grid is captured once
+    // and replayed, compare the timings with --no-draw-cache
+    Window *panel_window = app.create_window("Static", 640, 480);
+    auto    panel        = std::make_unique<ApplicationWindow>("static", panel_window);
+    auto    grid         = std::make_unique<Grid>("grid");
+
+    grid->set_columns(4);
+    grid->set_cacheable(draw_cache);
+    grid->set_rows(64);
+    for (uint32_t row = 0; row < 64; ++row) {
+        for (uint32_t column = 0; column < 4; ++column) {
+            auto cell = std::make_unique<Label>("cell" + std::to_string(column));
+            cell->set_text("row " + std::to_string(row) + " column " + std::to_string(column));
+            grid->set_widget(row, column, std::move(cell));
+        }
+    }
+    panel->set_title("Static");
+    panel->set_widget(std::move(grid));
+    panel_window->set_root(std::move(panel));
+
     while (!app.should_close()) {
         app.poll_events();
         app.frame_move();
@@ -0,0 +1,342 @@
+#include "metric_grid.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#    include <immintrin.h>
+#endif
+
+namespace {
+
+// space between sparkline tiles
+constexpr float tile_gap = 4.0f;
+
+// quads one reserve may take with 16 bit indices, the draw list starts a new
+// vertex offset whenever the next reserve would not fit
+constexpr uint32_t max_quads_16 = 0xffff / 4;
+
+// where red, green, blue and alpha sit in an ImU32
+constexpr int channel_shifts[4] = {IM_COL32_R_SHIFT, IM_COL32_G_SHIFT, IM_COL32_B_SHIFT,
+                                   IM_COL32_A_SHIFT};
+
+// write the four corners of every sample of the run colored by value, both
+// paths do the same arithmetic so the colors match to the bit
+void write_quads(ImDrawVert *vtx, const float *values, uint32_t count, float x, float step,
+                 float top, float height, float lift, float scale, float offset,
+                 const float (&base)[4], const float (&first)[4], const float (&second)[4],
+                 const ImVec2 &uv) {
+    // the top edge sits fixed + raise * t above the bottom, the full height
+    // for heatmap cells and the value for bars
+    const float bottom = top + height;
+    const float fixed  = height * (1.0f - lift);
+    const float raise  = height * lift * 0.5f;
+
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    const __m128 zero       = _mm_setzero_ps();
+    const __m128 one        = _mm_set1_ps(1.0f);
+    const __m128 two        = _mm_set1_ps(2.0f);
+    const __m128 lanes      = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 scale4     = _mm_set1_ps(scale * 2.0f);
+    const __m128 offset4    = _mm_set1_ps(offset * 2.0f);
+    const __m128 step4      = _mm_set1_ps(step);
+    const __m128 x4         = _mm_set1_ps(x);
+    const __m128 bottom4    = _mm_set1_ps(bottom);
+    const __m128 fixed4     = _mm_set1_ps(fixed);
+    const __m128 raise4     = _mm_set1_ps(raise);
+    const __m128 base4[4]   = {_mm_set1_ps(base[0] + 0.5f), _mm_set1_ps(base[1] + 0.5f),
+                               _mm_set1_ps(base[2] + 0.5f), _mm_set1_ps(base[3] + 0.5f)};
+    const __m128 first4[4]  = {_mm_set1_ps(first[0]), _mm_set1_ps(first[1]),
+                               _mm_set1_ps(first[2]), _mm_set1_ps(first[3])};
+    const __m128 second4[4] = {_mm_set1_ps(second[0]), _mm_set1_ps(second[1]),
+                               _mm_set1_ps(second[2]), _mm_set1_ps(second[3])};
+
+    alignas(16) float    x0[4], x1[4], y0[4];
+    alignas(16) uint32_t col[4];
+    for (; i + 4 <= count; i += 4) {
+        // twice the normalized value, max first so NaN ends up as 0
+        __m128 t2 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + i), scale4), offset4);
+        t2        = _mm_min_ps(_mm_max_ps(t2, zero), two);
+        const __m128 s = _mm_min_ps(t2, one);
+        const __m128 u = _mm_max_ps(_mm_sub_ps(t2, one), zero);
+
+        __m128i packed = _mm_setzero_si128();
+        for (int c = 0; c < 4; ++c) {
+            const __m128 channel = _mm_add_ps(
+                base4[c], _mm_add_ps(_mm_mul_ps(first4[c], s), _mm_mul_ps(second4[c], u)));
+            packed = _mm_or_si128(packed, _mm_sll_epi32(_mm_cvttps_epi32(channel),
+                                                        _mm_cvtsi32_si128(channel_shifts[c])));
+        }
+        _mm_store_si128(reinterpret_cast<__m128i *>(col), packed);
+
+        const __m128 left
+            = _mm_add_ps(x4, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes),
+                                        step4));
+        _mm_store_ps(x0, left);
+        _mm_store_ps(x1, _mm_add_ps(left, step4));
+        _mm_store_ps(y0, _mm_sub_ps(bottom4, _mm_add_ps(fixed4, _mm_mul_ps(raise4, t2))));
+
+        for (int k = 0; k < 4; ++k) {
+            vtx[0] = {{x0[k], y0[k]}, uv, col[k]};
+            vtx[1] = {{x1[k], y0[k]}, uv, col[k]};
+            vtx[2] = {{x1[k], bottom}, uv, col[k]};
+            vtx[3] = {{x0[k], bottom}, uv, col[k]};
+            vtx += 4;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        // written so NaN fails both compares and ends up as 0
+        float t2 = values[i] * (scale * 2.0f) + offset * 2.0f;
+        t2       = t2 > 0.0f ? (t2 < 2.0f ? t2 : 2.0f) : 0.0f;
+        const float s = std::min(t2, 1.0f);
+        const float u = std::max(t2 - 1.0f, 0.0f);
+
+        ImU32 col = 0;
+        for (int c = 0; c < 4; ++c) {
+            col |= static_cast<ImU32>(
+                       static_cast<int>((base[c] + 0.5f) + (first[c] * s + second[c] * u)))
+                   << channel_shifts[c];
+        }
+
+        const float left  = x + static_cast<float>(i) * step;
+        const float right = left + step;
+        const float upper = bottom - (fixed + raise * t2);
+        vtx[0]            = {{left, upper}, uv, col};
+        vtx[1]            = {{right, upper}, uv, col};
+        vtx[2]            = {{right, bottom}, uv, col};
+        vtx[3]            = {{left, bottom}, uv, col};
+        vtx += 4;
+    }
+}
+
+// two triangles per quad, the vertices of quad q start at base + 4q
+void write_indices(ImDrawIdx *idx, uint32_t base, uint32_t quads) {
+    uint32_t q = 0;
+#if defined(__SSE2__)
+    if constexpr (sizeof(ImDrawIdx) == 2) {
+        // the 24 indices of four quads
+        const __m128i pattern0 = _mm_setr_epi16(0, 1, 2, 0, 2, 3, 4, 5);
+        const __m128i pattern1 = _mm_setr_epi16(6, 4, 6, 7, 8, 9, 10, 8);
+        const __m128i pattern2 = _mm_setr_epi16(10, 11, 12, 13, 14, 12, 14, 15);
+        const __m128i advance  = _mm_set1_epi16(16);
+
+        __m128i offset = _mm_set1_epi16(static_cast<short>(base));
+        for (; q + 4 <= quads; q += 4) {
+            auto *out = reinterpret_cast<__m128i *>(idx);
+            _mm_storeu_si128(out + 0, _mm_add_epi16(pattern0, offset));
+            _mm_storeu_si128(out + 1, _mm_add_epi16(pattern1, offset));
+            _mm_storeu_si128(out + 2, _mm_add_epi16(pattern2, offset));
+            offset = _mm_add_epi16(offset, advance);
+            idx += 24;
+        }
+    }
+#endif
+    for (; q < quads; ++q) {
+        const auto first = static_cast<ImDrawIdx>(base + q * 4);
+        idx[0]           = first;
+        idx[1]           = static_cast<ImDrawIdx>(first + 1);
+        idx[2]           = static_cast<ImDrawIdx>(first + 2);
+        idx[3]           = first;
+        idx[4]           = static_cast<ImDrawIdx>(first + 2);
+        idx[5]           = static_cast<ImDrawIdx>(first + 3);
+        idx += 6;
+    }
+}
+
+} // namespace
+
+MetricGrid::MetricGrid(const std::string &name) : Widget(name) {
+    this->set_colors(IM_COL32(20, 30, 80, 255), IM_COL32(40, 170, 140, 255),
+                     IM_COL32(250, 230, 60, 255));
+}
+
+void MetricGrid::update(float dt) {
+    (void) dt;
+    if (!this->source || this->values.empty()) {
+        return;
+    }
+    // only a real change bumps the revision, bitwise so a NaN that stays NaN
+    // is none; the bounds never depend on it, they are measured when drawn
+    this->source(this->staged.data(), this->rows, this->columns);
+    const size_t bytes = this->values.size() * sizeof(float);
+    if (std::memcmp(this->staged.data(), this->values.data(), bytes) != 0) {
+        std::swap(this->values, this->staged);
+        this->invalidate_deferred();
+    }
+}
+
+void MetricGrid::set_shape(uint32_t rows, uint32_t columns) {
+    this->rows    = rows;
+    this->columns = columns;
+    this->values.assign(static_cast<size_t>(rows) * columns, 0.0f);
+    this->staged.assign(this->values.size(), 0.0f);
+    this->invalidate();
+}
+
+void MetricGrid::set_values(const float *values) {
+    std::copy_n(values, this->values.size(), this->values.begin());
+    this->invalidate();
+}
+
+void MetricGrid::set_colors(ImU32 low, ImU32 middle, ImU32 high) {
+    for (int c = 0; c < 4; ++c) {
+        const float from = static_cast<float>((low >> channel_shifts[c]) & 0xff);
+        const float mid  = static_cast<float>((middle >> channel_shifts[c]) & 0xff);
+        const float to   = static_cast<float>((high >> channel_shifts[c]) & 0xff);
+        this->gradient.base[c]   = from;
+        this->gradient.first[c]  = mid - from;
+        this->gradient.second[c] = to - mid;
+    }
+    this->invalidate();
+}
+
+ImVec2 MetricGrid::get_size() const {
+    if (this->mode == Mode::Heatmap) {
+        return ImVec2(this->columns * this->cell.x, this->rows * this->cell.y);
+    }
+    const uint32_t across = std::min(this->tile_columns, this->rows);
+    const uint32_t down   = (this->rows + this->tile_columns - 1) / this->tile_columns;
+    const float    width  = this->columns * this->cell.x;
+    return ImVec2(across * (width + tile_gap) - (across ? tile_gap : 0.0f),
+                  down * (this->cell.y + tile_gap) - (down ? tile_gap : 0.0f));
+}
+
+ImVec2 MetricGrid::tile_origin(uint32_t row) const {
+    const float width = this->columns * this->cell.x;
+    return ImVec2((row % this->tile_columns) * (width + tile_gap),
+                  (row / this->tile_columns) * (this->cell.y + tile_gap));
+}
+
+void MetricGrid::render() {
+    ImGui::PushID(this->name.c_str());
+
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::Dummy(this->get_size());
+    if (ImGui::IsItemVisible() && !this->values.empty()) {
+        ImDrawList  *draw_list = ImGui::GetWindowDrawList();
+        const ImVec2 clip_min  = draw_list->GetClipRectMin();
+        const ImVec2 clip_max  = draw_list->GetClipRectMax();
+        this->emit(draw_list, origin, ImVec4(clip_min.x, clip_min.y, clip_max.x, clip_max.y));
+        if (ImGui::IsItemHovered()) {
+            this->show_tooltip(origin);
+        }
+    }
+
+    ImGui::PopID();
+}
+
+void MetricGrid::emit(ImDrawList *draw_list, const ImVec2 &origin, const ImVec4 &clip) {
+    // collect the visible part of every visible metric
+    this->runs.clear();
+    uint64_t   total   = 0;
+    const auto add_run = [&](uint32_t row, float left, float top, float lift) {
+        if (top > clip.w || top + this->cell.y < clip.y) {
+            return;
+        }
+        const float first = std::floor((clip.x - left) / this->cell.x);
+        const float last  = std::ceil((clip.z - left) / this->cell.x);
+        const auto  begin = static_cast<uint32_t>(std::clamp(first, 0.0f, float(this->columns)));
+        const auto  end   = static_cast<uint32_t>(std::clamp(last, 0.0f, float(this->columns)));
+        if (begin >= end) {
+            return;
+        }
+        const float *values = this->values.data() + static_cast<size_t>(row) * this->columns;
+        this->runs.push_back({values + begin, end - begin, left + begin * this->cell.x, top,
+                              this->cell.y, lift});
+        total += end - begin;
+    };
+    if (this->mode == Mode::Heatmap) {
+        const auto first = static_cast<uint32_t>(
+            std::clamp(std::floor((clip.y - origin.y) / this->cell.y), 0.0f, float(this->rows)));
+        const auto last = static_cast<uint32_t>(
+            std::clamp(std::ceil((clip.w - origin.y) / this->cell.y), 0.0f, float(this->rows)));
+        for (uint32_t row = first; row < last; ++row) {
+            add_run(row, origin.x, origin.y + row * this->cell.y, 0.0f);
+        }
+    } else {
+        for (uint32_t row = 0; row < this->rows; ++row) {
+            const ImVec2 tile = this->tile_origin(row);
+            add_run(row, origin.x + tile.x, origin.y + tile.y, 1.0f);
+        }
+    }
+
+    // with 16 bit indices a reserve has to stay below 64k vertices, without
+    // vertex offsets the whole draw list does
+    uint64_t batch_limit = total;
+    if constexpr (sizeof(ImDrawIdx) == 2) {
+        if (draw_list->Flags & ImDrawListFlags_AllowVtxOffset) {
+            batch_limit = max_quads_16;
+        } else {
+            total       = std::min<uint64_t>(total, (0xffff - draw_list->_VtxCurrentIdx) / 4);
+            batch_limit = total;
+        }
+    }
+
+    const float  range  = this->high - this->low;
+    const float  scale  = range != 0.0f ? 1.0f / range : 0.0f;
+    const float  offset = -this->low * scale;
+    const ImVec2 uv     = draw_list->_Data->TexUvWhitePixel;
+
+    size_t   run   = 0;
+    uint32_t taken = 0;
+    while (total > 0) {
+        const auto batch = static_cast<uint32_t>(std::min(total, batch_limit));
+        draw_list->PrimReserve(static_cast<int>(batch * 6), static_cast<int>(batch * 4));
+
+        // fill the reserved quads from the runs, a run may span two batches
+        ImDrawVert *vtx  = draw_list->_VtxWritePtr;
+        uint32_t    left = batch;
+        while (left > 0) {
+            const Run     &current = this->runs[run];
+            const uint32_t count   = std::min(current.count - taken, left);
+            write_quads(vtx, current.values + taken, count, current.x + taken * this->cell.x,
+                        this->cell.x, current.top, current.height, current.lift, scale, offset,
+                        this->gradient.base, this->gradient.first, this->gradient.second, uv);
+            vtx += count * 4;
+            left -= count;
+            taken += count;
+            if (taken == current.count) {
+                ++run;
+                taken = 0;
+            }
+        }
+        write_indices(draw_list->_IdxWritePtr, draw_list->_VtxCurrentIdx, batch);
+
+        draw_list->_VtxWritePtr += batch * 4;
+        draw_list->_IdxWritePtr += batch * 6;
+        draw_list->_VtxCurrentIdx += batch * 4;
+        total -= batch;
+    }
+}
+
+void MetricGrid::show_tooltip(const ImVec2 &origin) const {
+    const ImVec2 mouse = ImGui::GetMousePos();
+    ImVec2       local(mouse.x - origin.x, mouse.y - origin.y);
+
+    uint32_t row;
+    if (this->mode == Mode::Heatmap) {
+        row = static_cast<uint32_t>(local.y / this->cell.y);
+    } else {
+        const float width  = this->columns * this->cell.x;
+        const auto  across = static_cast<uint32_t>(local.x / (width + tile_gap));
+        const auto  down   = static_cast<uint32_t>(local.y / (this->cell.y + tile_gap));
+        if (across >= this->tile_columns) {
+            return;
+        }
+        row               = down * this->tile_columns + across;
+        const ImVec2 tile = this->tile_origin(row);
+        local.x -= tile.x;
+        local.y -= tile.y;
+        if (local.x >= width || local.y >= this->cell.y) {
+            return;
+        }
+    }
+    const auto column = static_cast<uint32_t>(local.x / this->cell.x);
+    if (local.x < 0.0f || local.y < 0.0f || row >= this->rows || column >= this->columns) {
+        return;
+    }
+    ImGui::SetTooltip("metric %u, sample %u: %g", row, column,
+                      this->values[static_cast<size_t>(row) * this->columns + column]);
+}
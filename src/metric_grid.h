@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "widget.h"
+
+// thousands of small metrics in one item, a dense matrix with one row per
+// metric and one column per sample is drawn as a heatmap or as a grid of bar
+// sparklines, the quads are written straight into the window draw list
+class MetricGrid : public Widget {
+public:
+    enum class Mode {
+        // one cell per value, rows stacked from the top
+        Heatmap,
+        // one tile per metric, a bar per sample rising from the tile bottom
+        Sparklines,
+    };
+
+    // fills rows * columns values, the samples of every metric contiguous
+    using Source = std::function<void(float *values, uint32_t rows, uint32_t columns)>;
+
+    MetricGrid(const std::string &name);
+    virtual ~MetricGrid() = default;
+
+    virtual void update(float dt) override;
+
+    virtual void render() override;
+
+    // resize the matrix, the values are cleared
+    void set_shape(uint32_t rows, uint32_t columns);
+
+    // copy rows * columns values laid out like the source fills them
+    void set_values(const float *values);
+
+    // pull the values from a model on every update instead of set_values, the
+    // source writes all of them and the grid redraws only when one changed
+    void set_source(Source source) {
+        this->source = std::move(source);
+        this->invalidate_structure();
+    }
+
+    virtual bool has_update() const override {
+        return static_cast<bool>(this->source);
+    }
+
+    void set_mode(Mode mode) {
+        this->mode = mode;
+        this->invalidate();
+    }
+
+    // values mapped to the low and the high color, anything outside is
+    // clamped and NaN shows as low
+    void set_range(float low, float high) {
+        this->low  = low;
+        this->high = high;
+        this->invalidate();
+    }
+
+    // gradient through three colors, the middle one sits halfway
+    void set_colors(ImU32 low, ImU32 middle, ImU32 high);
+
+    // size of a heatmap cell, or width of a sparkline bar and height of a tile
+    void set_cell_size(const ImVec2 &size) {
+        this->cell = size;
+        this->invalidate();
+    }
+
+    // sparkline tiles per row
+    void set_tile_columns(uint32_t columns) {
+        this->tile_columns = std::max<uint32_t>(columns, 1);
+        this->invalidate();
+    }
+
+private:
+    // the gradient as base + first * min(2t, 1) + second * max(2t - 1, 0) per
+    // channel, in 0..255
+    struct Gradient {
+        float base[4];
+        float first[4];
+        float second[4];
+    };
+
+    // a run of samples of one metric, laid out left to right from x
+    struct Run {
+        const float *values;
+        uint32_t     count;
+        float        x;
+        float        top;
+        float        height;
+        // 0 for heatmap cells, 1 for bars that rise with the value
+        float        lift;
+    };
+
+    ImVec2 get_size() const;
+
+    // origin of the sparkline tile of a metric relative to the widget
+    ImVec2 tile_origin(uint32_t row) const;
+
+    void emit(ImDrawList *draw_list, const ImVec2 &origin, const ImVec4 &clip);
+
+    void show_tooltip(const ImVec2 &origin) const;
+
+    Mode     mode{Mode::Heatmap};
+    uint32_t rows{0};
+    uint32_t columns{0};
+    float    low{0.0f};
+    float    high{1.0f};
+    ImVec2   cell{4.0f, 4.0f};
+    uint32_t tile_columns{8};
+    Gradient gradient{};
+
+    std::vector<float> values;
+    Source             source;
+    // filled by the source and swapped in when it differs from values
+    std::vector<float> staged;
+
+    // visible runs of the last render, kept for the capacity
+    std::vector<Run> runs;
+};
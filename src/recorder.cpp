@@ -0,0 +1,171 @@
+#include "recorder.h"
+
+#include <cstring>
+
+namespace {
+
+// "IREC" and the version of the layout below, fields are stored in host byte
+// order, recordings are meant to be replayed on the machine that made them
+constexpr uint32_t file_magic   = 0x43455249;
+constexpr uint32_t file_version = 3;
+
+// written once the buffer holds this much
+constexpr size_t flush_size = 64 << 10;
+
+// each event is its frame, type and window followed by only the arguments
+// its type uses
+struct Layout {
+    uint8_t ints;
+    uint8_t doubles;
+};
+
+Layout layout_of(Recorder::Type type) {
+    switch (type) {
+    case Recorder::Type::WindowFocus:
+    case Recorder::Type::CursorEnter:
+    case Recorder::Type::Char:
+        return {1, 0};
+    case Recorder::Type::CursorPos:
+    case Recorder::Type::Scroll:
+        return {0, 2};
+    case Recorder::Type::MouseButton:
+        return {3, 0};
+    case Recorder::Type::Key:
+        return {4, 0};
+    case Recorder::Type::WindowSize:
+    case Recorder::Type::WindowCreate:
+        return {2, 0};
+    case Recorder::Type::WindowState:
+        return {4, 2};
+    case Recorder::Type::Update:
+        return {1, 1};
+    default:
+        return {0, 0};
+    }
+}
+
+template <typename T>
+void put(std::string &buffer, const T &value) {
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+bool get(const std::string &data, size_t &offset, T &value) {
+    if (data.size() - offset < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+} // namespace
+
+Recorder::~Recorder() {
+    if (this->file) {
+        std::fwrite(this->buffer.data(), 1, this->buffer.size(), this->file);
+        std::fclose(this->file);
+    }
+}
+
+bool Recorder::record(const std::string &path) {
+    this->file = std::fopen(path.c_str(), "wb");
+    if (this->file == nullptr) {
+        return false;
+    }
+    this->mode = Mode::Record;
+    this->buffer.reserve(flush_size * 2);
+    put(this->buffer, file_magic);
+    put(this->buffer, file_version);
+    return true;
+}
+
+bool Recorder::replay(const std::string &path) {
+    std::FILE *input = std::fopen(path.c_str(), "rb");
+    if (input == nullptr) {
+        return false;
+    }
+    std::string data;
+    char        chunk[flush_size];
+    size_t      read;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), input)) > 0) {
+        data.append(chunk, read);
+    }
+    std::fclose(input);
+
+    size_t   offset = 0;
+    uint32_t magic, version;
+    if (!get(data, offset, magic) || !get(data, offset, version) || magic != file_magic
+        || version != file_version) {
+        return false;
+    }
+
+    // a recording cut short by a crash still replays up to its last event
+    this->events.clear();
+    Event event;
+    while (get(data, offset, event.frame) && get(data, offset, event.type)
+           && get(data, offset, event.window)) {
+        const Layout layout = layout_of(event.type);
+        bool         valid  = true;
+        for (uint8_t i = 0; i < layout.ints; ++i) {
+            valid = valid && get(data, offset, event.args[i]);
+        }
+        if (layout.doubles > 0) {
+            valid = valid && get(data, offset, event.x);
+        }
+        if (layout.doubles > 1) {
+            valid = valid && get(data, offset, event.y);
+        }
+        if (!valid) {
+            break;
+        }
+        if (event.type == Type::End) {
+            this->end_frame = event.frame;
+            break;
+        }
+        this->events.push_back(event);
+        this->end_frame = event.frame + 1;
+    }
+
+    this->mode   = Mode::Replay;
+    this->cursor = 0;
+    return true;
+}
+
+void Recorder::close(uint32_t frame) {
+    if (this->mode != Mode::Record || this->file == nullptr) {
+        return;
+    }
+    Event end;
+    end.frame = frame;
+    end.type  = Type::End;
+    this->write(end);
+
+    std::fwrite(this->buffer.data(), 1, this->buffer.size(), this->file);
+    std::fclose(this->file);
+    this->file = nullptr;
+    this->buffer.clear();
+    this->mode = Mode::Off;
+}
+
+void Recorder::write(const Event &event) {
+    put(this->buffer, event.frame);
+    put(this->buffer, event.type);
+    put(this->buffer, event.window);
+
+    const Layout layout = layout_of(event.type);
+    for (uint8_t i = 0; i < layout.ints; ++i) {
+        put(this->buffer, event.args[i]);
+    }
+    if (layout.doubles > 0) {
+        put(this->buffer, event.x);
+    }
+    if (layout.doubles > 1) {
+        put(this->buffer, event.y);
+    }
+
+    if (this->buffer.size() >= flush_size) {
+        std::fwrite(this->buffer.data(), 1, this->buffer.size(), this->file);
+        this->buffer.clear();
+    }
+}
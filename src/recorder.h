@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// input of all windows and async updates, written to or read back from a
+// compact binary file, every event carries the frame it was seen in so a
+// replay feeds it to the same frame again
+class Recorder {
+public:
+    enum class Mode {
+        Off,
+        Record,
+        Replay,
+    };
+
+    enum class Type : uint8_t {
+        WindowFocus,
+        CursorEnter,
+        CursorPos,
+        MouseButton,
+        Scroll,
+        Key,
+        Char,
+        WindowSize,
+        // size, focus and cursor of a window when the recording starts
+        // covering it, so a replay does not start from the live state
+        WindowState,
+        // a value posted by Application::post_update
+        Update,
+        // a window was opened with the size in args, a replay opens its
+        // windows itself and only checks that their ids line up
+        WindowCreate,
+        // a secondary window was closed, a replay closes it in the same frame
+        WindowClose,
+        // the last frame of the recording
+        End,
+    };
+
+    // the arguments used depend on the type, in the order of the matching
+    // glfw callback, a window state keeps width, height, focused and hovered
+    // in args and the cursor in x and y, an update keeps its channel in args[0]
+    // and its value in x; window is the id create_window handed out, it stays
+    // the same when other windows close
+    struct Event {
+        uint32_t frame{0};
+        Type     type{Type::End};
+        uint32_t window{0};
+        int32_t  args[4]{};
+        double   x{0.0};
+        double   y{0.0};
+    };
+
+    Recorder() = default;
+    ~Recorder();
+
+    Recorder(const Recorder &)            = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    Mode get_mode() const noexcept {
+        return this->mode;
+    }
+
+    // start writing events to path, anything already there is replaced
+    bool record(const std::string &path);
+
+    // load all events of path, the live input is ignored from then on
+    bool replay(const std::string &path);
+
+    // write the end marker and close the file
+    void close(uint32_t frame);
+
+    // append an event, UI thread only
+    void write(const Event &event);
+
+    // events of the given frame, frames have to be asked for in order
+    template <typename Callback>
+    void read(uint32_t frame, Callback callback) {
+        while (this->cursor < this->events.size() && this->events[this->cursor].frame <= frame) {
+            callback(this->events[this->cursor++]);
+        }
+    }
+
+    // a replay is finished once its end frame has been reached
+    bool finished(uint32_t frame) const noexcept {
+        return this->mode == Mode::Replay && frame >= this->end_frame;
+    }
+
+private:
+    Mode        mode{Mode::Off};
+    std::FILE  *file{nullptr};
+    std::string buffer;
+
+    std::vector<Event> events;
+    size_t             cursor{0};
+    uint32_t           end_frame{0};
+};
@@ -0,0 +1,919 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+// generated from src/shaders at build time
+#include "shaders/imgui.frag.h"
+#include "shaders/imgui.vert.h"
+
+namespace {
+
+// indices per chunk before a frame is worth splitting across threads, below
+// that a secondary command buffer costs more than it saves
+constexpr uint32_t chunk_indices = 32768;
+// fixed cost of a draw command in indices, keeps chunks of many small
+// commands from getting too long
+constexpr uint32_t command_cost = 64;
+// batches a draw command may sink back past to join one of the same state,
+// bounds the search on lists with many clip rects
+constexpr uint32_t merge_window = 16;
+
+constexpr VkDeviceSize min_buffer_size = 1 << 20;
+
+void check(VkResult err) {
+    if (err == VK_SUCCESS) {
+        return;
+    }
+    fprintf(stderr, "[renderer] Error: VkResult = %d\n", err);
+    if (err < 0) {
+        std::terminate();
+    }
+}
+
+VkDeviceSize align_up(VkDeviceSize size, VkDeviceSize alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+bool same_state(const ImDrawCmd &a, const ImDrawCmd &b) {
+    return a.TextureId == b.TextureId && a.VtxOffset == b.VtxOffset
+           && a.ClipRect.x == b.ClipRect.x && a.ClipRect.y == b.ClipRect.y
+           && a.ClipRect.z == b.ClipRect.z && a.ClipRect.w == b.ClipRect.w;
+}
+
+// scissors only shrink clip rects, what is disjoint here never overlaps on screen
+bool overlaps(const ImVec4 &a, const ImVec4 &b) {
+    return a.x < b.z && b.x < a.z && a.y < b.w && b.y < a.w;
+}
+
+} // namespace
+
+Renderer::Renderer(const InitInfo &info) : info(info) {
+    VkResult err;
+
+    vkGetPhysicalDeviceMemoryProperties(info.physical_device, &this->memory_properties);
+
+    {
+        VkSamplerCreateInfo sampler_info = {};
+        sampler_info.sType               = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_info.magFilter           = VK_FILTER_LINEAR;
+        sampler_info.minFilter           = VK_FILTER_LINEAR;
+        sampler_info.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        sampler_info.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.minLod              = -1000;
+        sampler_info.maxLod              = 1000;
+        sampler_info.maxAnisotropy       = 1.0f;
+        err = vkCreateSampler(info.device, &sampler_info, info.allocator, &this->sampler);
+        check(err);
+    }
+
+    {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.descriptorType               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount              = 1;
+        binding.stageFlags                   = VK_SHADER_STAGE_FRAGMENT_BIT;
+        binding.pImmutableSamplers           = &this->sampler;
+
+        VkDescriptorSetLayoutCreateInfo layout_info = {};
+        layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = 1;
+        layout_info.pBindings    = &binding;
+        err = vkCreateDescriptorSetLayout(info.device, &layout_info, info.allocator,
+                                          &this->descriptor_set_layout);
+        check(err);
+    }
+
+    {
+        // scale and translate of the display rectangle
+        VkPushConstantRange push_constants = {};
+        push_constants.stageFlags          = VK_SHADER_STAGE_VERTEX_BIT;
+        push_constants.offset              = 0;
+        push_constants.size                = sizeof(float) * 4;
+
+        VkPipelineLayoutCreateInfo layout_info = {};
+        layout_info.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_info.setLayoutCount             = 1;
+        layout_info.pSetLayouts                = &this->descriptor_set_layout;
+        layout_info.pushConstantRangeCount     = 1;
+        layout_info.pPushConstantRanges        = &push_constants;
+        err = vkCreatePipelineLayout(info.device, &layout_info, info.allocator,
+                                     &this->pipeline_layout);
+        check(err);
+    }
+
+    {
+        VkShaderModuleCreateInfo module_info = {};
+        module_info.sType                    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_info.codeSize                 = sizeof(imgui_vert_spv);
+        module_info.pCode                    = imgui_vert_spv;
+        err = vkCreateShaderModule(info.device, &module_info, info.allocator,
+                                   &this->vertex_shader);
+        check(err);
+        module_info.codeSize = sizeof(imgui_frag_spv);
+        module_info.pCode    = imgui_frag_spv;
+        err = vkCreateShaderModule(info.device, &module_info, info.allocator,
+                                   &this->fragment_shader);
+        check(err);
+    }
+}
+
+Renderer::~Renderer() {
+    VkDevice                     device    = this->info.device;
+    const VkAllocationCallbacks *allocator = this->info.allocator;
+
+    if (this->font_texture.descriptor_set != VK_NULL_HANDLE) {
+        vkFreeDescriptorSets(device, this->info.descriptor_pool, 1,
+                             &this->font_texture.descriptor_set);
+    }
+    vkDestroyImageView(device, this->font_texture.view, allocator);
+    vkDestroyImage(device, this->font_texture.image, allocator);
+    vkFreeMemory(device, this->font_texture.memory, allocator);
+
+    for (auto &[format, pipeline] : this->pipelines) {
+        vkDestroyPipeline(device, pipeline, allocator);
+    }
+    vkDestroyShaderModule(device, this->vertex_shader, allocator);
+    vkDestroyShaderModule(device, this->fragment_shader, allocator);
+    vkDestroyPipelineLayout(device, this->pipeline_layout, allocator);
+    vkDestroyDescriptorSetLayout(device, this->descriptor_set_layout, allocator);
+    vkDestroySampler(device, this->sampler, allocator);
+}
+
+void Renderer::upload_fonts() {
+    VkDevice                     device    = this->info.device;
+    const VkAllocationCallbacks *allocator = this->info.allocator;
+    VkResult                     err;
+
+    unsigned char *pixels;
+    int            width, height;
+    this->font_atlas.GetTexDataAsRGBA32(&pixels, &width, &height);
+    const VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+    {
+        VkImageCreateInfo image_info = {};
+        image_info.sType             = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType         = VK_IMAGE_TYPE_2D;
+        image_info.format            = VK_FORMAT_R8G8B8A8_UNORM;
+        image_info.extent.width      = width;
+        image_info.extent.height     = height;
+        image_info.extent.depth      = 1;
+        image_info.mipLevels         = 1;
+        image_info.arrayLayers       = 1;
+        image_info.samples           = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        err = vkCreateImage(device, &image_info, allocator, &this->font_texture.image);
+        check(err);
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, this->font_texture.image, &requirements);
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize       = requirements.size;
+        alloc_info.memoryTypeIndex      = this->find_memory_type(
+            requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        err = vkAllocateMemory(device, &alloc_info, allocator, &this->font_texture.memory);
+        check(err);
+        err = vkBindImageMemory(device, this->font_texture.image, this->font_texture.memory, 0);
+        check(err);
+    }
+
+    {
+        VkImageViewCreateInfo view_info       = {};
+        view_info.sType                       = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image                       = this->font_texture.image;
+        view_info.viewType                    = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format                      = VK_FORMAT_R8G8B8A8_UNORM;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.layerCount = 1;
+        err = vkCreateImageView(device, &view_info, allocator, &this->font_texture.view);
+        check(err);
+    }
+
+    {
+        VkDescriptorSetAllocateInfo alloc_info = {};
+        alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool     = this->info.descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts        = &this->descriptor_set_layout;
+        err = vkAllocateDescriptorSets(device, &alloc_info, &this->font_texture.descriptor_set);
+        check(err);
+
+        VkDescriptorImageInfo image_info = {};
+        image_info.sampler               = this->sampler;
+        image_info.imageView             = this->font_texture.view;
+        image_info.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write = {};
+        write.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet               = this->font_texture.descriptor_set;
+        write.descriptorCount      = 1;
+        write.descriptorType       = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo           = &image_info;
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    }
+
+    // staging copy, the only upload that does not go through a mapped buffer
+    // the gpu reads directly
+    VkBuffer       staging;
+    VkDeviceMemory staging_memory;
+    {
+        VkBufferCreateInfo buffer_info = {};
+        buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size               = size;
+        buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+        err = vkCreateBuffer(device, &buffer_info, allocator, &staging);
+        check(err);
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, staging, &requirements);
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize       = requirements.size;
+        alloc_info.memoryTypeIndex
+            = this->find_memory_type(requirements.memoryTypeBits,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     0);
+        err = vkAllocateMemory(device, &alloc_info, allocator, &staging_memory);
+        check(err);
+        err = vkBindBufferMemory(device, staging, staging_memory, 0);
+        check(err);
+
+        void *mapped;
+        err = vkMapMemory(device, staging_memory, 0, size, 0, &mapped);
+        check(err);
+        std::memcpy(mapped, pixels, size);
+        vkUnmapMemory(device, staging_memory);
+    }
+
+    VkCommandPool   command_pool;
+    VkCommandBuffer command_buffer;
+    {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex        = this->info.queue_family;
+        err = vkCreateCommandPool(device, &pool_info, allocator, &command_pool);
+        check(err);
+
+        VkCommandBufferAllocateInfo alloc_info = {};
+        alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool        = command_pool;
+        alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        err = vkAllocateCommandBuffers(device, &alloc_info, &command_buffer);
+        check(err);
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        err = vkBeginCommandBuffer(command_buffer, &begin_info);
+        check(err);
+    }
+
+    {
+        VkImageMemoryBarrier barrier            = {};
+        barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image                           = this->font_texture.image;
+        barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount     = 1;
+        barrier.subresourceRange.layerCount     = 1;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_HOST_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+        VkBufferImageCopy region           = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width           = width;
+        region.imageExtent.height          = height;
+        region.imageExtent.depth           = 1;
+        vkCmdCopyBufferToImage(command_buffer, staging, this->font_texture.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1,
+                             &barrier);
+    }
+
+    {
+        err = vkEndCommandBuffer(command_buffer);
+        check(err);
+        VkSubmitInfo submit_info       = {};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &command_buffer;
+        err = vkQueueSubmit(this->info.queue, 1, &submit_info, VK_NULL_HANDLE);
+        check(err);
+        err = vkQueueWaitIdle(this->info.queue);
+        check(err);
+    }
+
+    vkDestroyCommandPool(device, command_pool, allocator);
+    vkDestroyBuffer(device, staging, allocator);
+    vkFreeMemory(device, staging_memory, allocator);
+
+    this->font_atlas.SetTexID((ImTextureID) this->font_texture.descriptor_set);
+}
+
+VkPipeline Renderer::get_pipeline(VkFormat format, VkRenderPass render_pass) {
+    for (const auto &[known, pipeline] : this->pipelines) {
+        if (known == format) {
+            return pipeline;
+        }
+    }
+
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage  = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = this->vertex_shader;
+    stages[0].pName  = "main";
+    stages[1].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = this->fragment_shader;
+    stages[1].pName  = "main";
+
+    VkVertexInputBindingDescription binding = {};
+    binding.stride                          = sizeof(ImDrawVert);
+    binding.inputRate                       = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription attributes[3] = {};
+    attributes[0].location = 0;
+    attributes[0].format   = VK_FORMAT_R32G32_SFLOAT;
+    attributes[0].offset   = offsetof(ImDrawVert, pos);
+    attributes[1].location = 1;
+    attributes[1].format   = VK_FORMAT_R32G32_SFLOAT;
+    attributes[1].offset   = offsetof(ImDrawVert, uv);
+    attributes[2].location = 2;
+    attributes[2].format   = VK_FORMAT_R8G8B8A8_UNORM;
+    attributes[2].offset   = offsetof(ImDrawVert, col);
+
+    VkPipelineVertexInputStateCreateInfo vertex_info = {};
+    vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_info.vertexBindingDescriptionCount   = 1;
+    vertex_info.pVertexBindingDescriptions      = &binding;
+    vertex_info.vertexAttributeDescriptionCount = 3;
+    vertex_info.pVertexAttributeDescriptions    = attributes;
+
+    VkPipelineInputAssemblyStateCreateInfo assembly_info = {};
+    assembly_info.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport_info = {};
+    viewport_info.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_info.viewportCount = 1;
+    viewport_info.scissorCount  = 1;
+
+    VkPipelineRasterizationStateCreateInfo raster_info = {};
+    raster_info.sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster_info.polygonMode = VK_POLYGON_MODE_FILL;
+    raster_info.cullMode    = VK_CULL_MODE_NONE;
+    raster_info.frontFace   = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    raster_info.lineWidth   = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample_info = {};
+    multisample_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blend_attachment = {};
+    blend_attachment.blendEnable                         = VK_TRUE;
+    blend_attachment.srcColorBlendFactor                 = VK_BLEND_FACTOR_SRC_ALPHA;
+    blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend_attachment.colorBlendOp        = VK_BLEND_OP_ADD;
+    blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend_attachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+    blend_attachment.colorWriteMask      = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+                                      | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depth_info = {};
+    depth_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+
+    VkPipelineColorBlendStateCreateInfo blend_info = {};
+    blend_info.sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend_info.attachmentCount = 1;
+    blend_info.pAttachments    = &blend_attachment;
+
+    VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_info = {};
+    dynamic_info.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_info.dynamicStateCount = 2;
+    dynamic_info.pDynamicStates    = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount          = 2;
+    pipeline_info.pStages             = stages;
+    pipeline_info.pVertexInputState   = &vertex_info;
+    pipeline_info.pInputAssemblyState = &assembly_info;
+    pipeline_info.pViewportState      = &viewport_info;
+    pipeline_info.pRasterizationState = &raster_info;
+    pipeline_info.pMultisampleState   = &multisample_info;
+    pipeline_info.pDepthStencilState  = &depth_info;
+    pipeline_info.pColorBlendState    = &blend_info;
+    pipeline_info.pDynamicState       = &dynamic_info;
+    pipeline_info.layout              = this->pipeline_layout;
+    pipeline_info.renderPass          = render_pass;
+    pipeline_info.subpass             = 0;
+
+    VkPipeline pipeline;
+    VkResult   err = vkCreateGraphicsPipelines(this->info.device, this->info.pipeline_cache, 1,
+                                               &pipeline_info, this->info.allocator, &pipeline);
+    check(err);
+    this->pipelines.emplace_back(format, pipeline);
+    return pipeline;
+}
+
+void Renderer::prepare(Target &target, const ImGui_ImplVulkanH_Window *wd) {
+    target.pipeline = this->get_pipeline(wd->SurfaceFormat.format, wd->RenderPass);
+
+    const size_t count = wd->ImageCount;
+    for (size_t i = count; i < target.frames.size(); ++i) {
+        this->destroy_frame(target.frames[i]);
+    }
+    target.frames.resize(count);
+}
+
+void Renderer::release(Target &target) {
+    for (auto &frame : target.frames) {
+        this->destroy_frame(frame);
+    }
+    target.frames.clear();
+    target.pipeline = VK_NULL_HANDLE;
+}
+
+void Renderer::reserve(Target::Frame &frame, VkDeviceSize size) {
+    if (frame.size >= size) {
+        return;
+    }
+
+    // grow geometrically so a slowly growing frame does not reallocate every
+    // time, the buffer stays mapped for its whole life
+    VkDeviceSize next = std::max(min_buffer_size, frame.size * 2);
+    while (next < size) {
+        next *= 2;
+    }
+
+    VkDevice                     device    = this->info.device;
+    const VkAllocationCallbacks *allocator = this->info.allocator;
+    VkResult                     err;
+
+    if (frame.buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, frame.buffer, allocator);
+        vkFreeMemory(device, frame.memory, allocator);
+    }
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size               = next;
+    buffer_info.usage       = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    err                     = vkCreateBuffer(device, &buffer_info, allocator, &frame.buffer);
+    check(err);
+
+    // device local when the device can map it, the copy then lands where the
+    // gpu reads it
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, frame.buffer, &requirements);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize       = requirements.size;
+    alloc_info.memoryTypeIndex      = this->find_memory_type(
+        requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    err = vkAllocateMemory(device, &alloc_info, allocator, &frame.memory);
+    check(err);
+    err = vkBindBufferMemory(device, frame.buffer, frame.memory, 0);
+    check(err);
+    err = vkMapMemory(device, frame.memory, 0, VK_WHOLE_SIZE, 0, &frame.mapped);
+    check(err);
+
+    frame.size = next;
+}
+
+void Renderer::destroy_frame(Target::Frame &frame) {
+    VkDevice                     device    = this->info.device;
+    const VkAllocationCallbacks *allocator = this->info.allocator;
+
+    if (frame.buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, frame.buffer, allocator);
+        vkFreeMemory(device, frame.memory, allocator);
+    }
+    // destroying a pool frees its command buffers
+    for (VkCommandPool pool : frame.pools) {
+        vkDestroyCommandPool(device, pool, allocator);
+    }
+    frame = Target::Frame();
+}
+
+uint32_t Renderer::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required,
+                                    VkMemoryPropertyFlags preferred) const {
+    uint32_t fallback = UINT32_MAX;
+    for (uint32_t i = 0; i < this->memory_properties.memoryTypeCount; ++i) {
+        const VkMemoryPropertyFlags flags = this->memory_properties.memoryTypes[i].propertyFlags;
+        if (!(type_bits & (1u << i)) || (flags & required) != required) {
+            continue;
+        }
+        if ((flags & preferred) == preferred) {
+            return i;
+        }
+        if (fallback == UINT32_MAX) {
+            fallback = i;
+        }
+    }
+    if (fallback == UINT32_MAX) {
+        fprintf(stderr, "[renderer] Error: no memory type for %#x\n", required);
+        std::terminate();
+    }
+    return fallback;
+}
+
+bool Renderer::has_user_callbacks(const ImDrawData *draw_data) {
+    for (int l = 0; l < draw_data->CmdListsCount; ++l) {
+        for (const ImDrawCmd &cmd : draw_data->CmdLists[l]->CmdBuffer) {
+            if (cmd.UserCallback != NULL && cmd.UserCallback != ImDrawCallback_ResetRenderState) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+uint32_t Renderer::merge(const ImDrawList *list, uint32_t idx_base, Target::Batch *batches,
+                         uint32_t *batch_of, ImDrawIdx *idx_dst) {
+    // a command joins the newest batch of its state when every batch opened
+    // after that one is clipped to a disjoint rect, drawing it earlier then
+    // changes no pixel; imgui itself only merges neighbours
+    uint32_t count = 0;
+    for (int c = 0; c < list->CmdBuffer.Size; ++c) {
+        const ImDrawCmd &cmd   = list->CmdBuffer[c];
+        uint32_t         batch = count;
+        if (cmd.UserCallback == NULL) {
+            for (uint32_t b = count; b > 0 && count - b < merge_window; --b) {
+                const ImDrawCmd &other = list->CmdBuffer[batches[b - 1].cmd];
+                if (other.UserCallback != NULL) {
+                    break;
+                }
+                if (same_state(other, cmd)) {
+                    batch = b - 1;
+                    break;
+                }
+                if (overlaps(other.ClipRect, cmd.ClipRect)) {
+                    break;
+                }
+            }
+        }
+        if (batch == count) {
+            batches[count++] = {c, 0, 0, 0};
+        }
+        if (cmd.UserCallback == NULL) {
+            batches[batch].count += cmd.ElemCount;
+        }
+        ++batches[batch].commands;
+        batch_of[c] = batch;
+    }
+
+    // lay the batches out back to back, then append the indices of every
+    // command to its batch in draw order
+    uint32_t first = idx_base;
+    for (uint32_t b = 0; b < count; ++b) {
+        batches[b].first = first;
+        first += batches[b].count;
+        batches[b].count = 0;
+    }
+    for (int c = 0; c < list->CmdBuffer.Size; ++c) {
+        const ImDrawCmd &cmd = list->CmdBuffer[c];
+        if (cmd.UserCallback != NULL) {
+            continue;
+        }
+        Target::Batch &batch = batches[batch_of[c]];
+        std::memcpy(idx_dst + batch.first + batch.count, list->IdxBuffer.Data + cmd.IdxOffset,
+                    cmd.ElemCount * sizeof(ImDrawIdx));
+        batch.count += cmd.ElemCount;
+    }
+    return count;
+}
+
+void Renderer::split(const Target &target, ImDrawData *draw_data, uint32_t count,
+                     std::vector<Target::Chunk> &chunks) {
+    chunks.clear();
+    const int lists = draw_data->CmdListsCount;
+    if (lists == 0) {
+        return;
+    }
+    if (has_user_callbacks(draw_data)) {
+        count = 1;
+    }
+
+    uint64_t total = 0;
+    for (int l = 0; l < lists; ++l) {
+        const Target::Batch *batches = target.batches.data() + target.batch_base[l];
+        for (uint32_t b = 0; b < target.batch_count[l]; ++b) {
+            total += batches[b].count + command_cost;
+        }
+    }
+
+    // cut once a chunk has its share, a chunk always ends after a whole
+    // batch so no draw straddles two chunks
+    const uint64_t share  = (total + count - 1) / count;
+    uint64_t       weight = 0;
+    Target::Chunk  chunk{0, 0, 0, 0};
+    for (int l = 0; l < lists && chunks.size() + 1 < count; ++l) {
+        const Target::Batch *batches = target.batches.data() + target.batch_base[l];
+        for (uint32_t b = 0; b < target.batch_count[l]; ++b) {
+            weight += batches[b].count + command_cost;
+            if (weight >= share && chunks.size() + 1 < count) {
+                chunk.last_list  = l;
+                chunk.last_batch = b + 1;
+                chunks.push_back(chunk);
+                chunk  = {l, b + 1, 0, 0};
+                weight = 0;
+            }
+        }
+    }
+    chunk.last_list  = lists - 1;
+    chunk.last_batch = target.batch_count[lists - 1];
+    if (chunks.empty() || chunk.first_list != chunk.last_list
+        || chunk.first_batch != chunk.last_batch) {
+        chunks.push_back(chunk);
+    }
+}
+
+void Renderer::setup_render_state(VkCommandBuffer command_buffer, VkPipeline pipeline,
+                                  VkBuffer buffer, VkDeviceSize index_offset,
+                                  ImDrawData *draw_data) const {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    const VkDeviceSize vertex_offset = 0;
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &buffer, &vertex_offset);
+    vkCmdBindIndexBuffer(command_buffer, buffer, index_offset,
+                         sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+
+    VkViewport viewport;
+    viewport.x        = 0;
+    viewport.y        = 0;
+    viewport.width    = draw_data->DisplaySize.x * draw_data->FramebufferScale.x;
+    viewport.height   = draw_data->DisplaySize.y * draw_data->FramebufferScale.y;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    float transform[4];
+    transform[0] = 2.0f / draw_data->DisplaySize.x;
+    transform[1] = 2.0f / draw_data->DisplaySize.y;
+    transform[2] = -1.0f - draw_data->DisplayPos.x * transform[0];
+    transform[3] = -1.0f - draw_data->DisplayPos.y * transform[1];
+    vkCmdPushConstants(command_buffer, this->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(transform), transform);
+}
+
+Renderer::Stats Renderer::record_chunk(VkCommandBuffer command_buffer, const Target &target,
+                                       const Target::Frame &frame, VkDeviceSize index_offset,
+                                       ImDrawData *draw_data, const Target::Chunk &chunk) const {
+    Stats stats;
+    this->setup_render_state(command_buffer, target.pipeline, frame.buffer, index_offset,
+                             draw_data);
+
+    const ImVec2 clip_off   = draw_data->DisplayPos;
+    const ImVec2 clip_scale = draw_data->FramebufferScale;
+    const float  fb_width   = draw_data->DisplaySize.x * clip_scale.x;
+    const float  fb_height  = draw_data->DisplaySize.y * clip_scale.y;
+
+    VkDescriptorSet bound = VK_NULL_HANDLE;
+    for (int l = chunk.first_list; l <= chunk.last_list; ++l) {
+        const ImDrawList    *list    = draw_data->CmdLists[l];
+        const Target::Batch *batches = target.batches.data() + target.batch_base[l];
+        const uint32_t       size    = target.batch_count[l];
+        const uint32_t       begin   = l == chunk.first_list ? chunk.first_batch : 0;
+        const uint32_t       end     = l == chunk.last_list ? chunk.last_batch : size;
+
+        for (uint32_t b = begin; b < end; ++b) {
+            const Target::Batch &batch = batches[b];
+            const ImDrawCmd     &cmd   = list->CmdBuffer[batch.cmd];
+            const uint32_t       count = batch.count;
+            stats.commands += batch.commands;
+
+            if (cmd.UserCallback != NULL) {
+                if (cmd.UserCallback == ImDrawCallback_ResetRenderState) {
+                    this->setup_render_state(command_buffer, target.pipeline, frame.buffer,
+                                             index_offset, draw_data);
+                    bound = VK_NULL_HANDLE;
+                } else {
+                    cmd.UserCallback(list, &cmd);
+                }
+                continue;
+            }
+
+            ImVec2 clip_min((cmd.ClipRect.x - clip_off.x) * clip_scale.x,
+                            (cmd.ClipRect.y - clip_off.y) * clip_scale.y);
+            ImVec2 clip_max((cmd.ClipRect.z - clip_off.x) * clip_scale.x,
+                            (cmd.ClipRect.w - clip_off.y) * clip_scale.y);
+            clip_min.x = std::max(clip_min.x, 0.0f);
+            clip_min.y = std::max(clip_min.y, 0.0f);
+            clip_max.x = std::min(clip_max.x, fb_width);
+            clip_max.y = std::min(clip_max.y, fb_height);
+            if (clip_max.x <= clip_min.x || clip_max.y <= clip_min.y || count == 0) {
+                continue;
+            }
+
+            VkRect2D scissor;
+            scissor.offset.x      = static_cast<int32_t>(clip_min.x);
+            scissor.offset.y      = static_cast<int32_t>(clip_min.y);
+            scissor.extent.width  = static_cast<uint32_t>(clip_max.x - clip_min.x);
+            scissor.extent.height = static_cast<uint32_t>(clip_max.y - clip_min.y);
+            vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+            VkDescriptorSet descriptor_set = (VkDescriptorSet) cmd.TextureId;
+            if (descriptor_set != bound) {
+                vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                        this->pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
+                bound = descriptor_set;
+            }
+
+            vkCmdDrawIndexed(command_buffer, count, 1, batch.first,
+                             cmd.VtxOffset + target.vtx_base[l], 0);
+            ++stats.draw_calls;
+        }
+    }
+    return stats;
+}
+
+Renderer::Stats Renderer::record(Target &target, ImGui_ImplVulkanH_Window *wd,
+                                 ImDrawData *draw_data) {
+    Stats                    stats;
+    VkResult                 err;
+    VkDevice                 device = this->info.device;
+    ImGui_ImplVulkanH_Frame *fd     = &wd->Frames[wd->FrameIndex];
+    Target::Frame           &frame  = target.frames[wd->FrameIndex];
+
+    // vertices of all lists first, then their indices
+    const int          lists        = draw_data->CmdListsCount;
+    const VkDeviceSize vtx_bytes    = draw_data->TotalVtxCount * sizeof(ImDrawVert);
+    const VkDeviceSize index_offset = align_up(vtx_bytes, 16);
+    const VkDeviceSize idx_bytes    = draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+
+    target.chunks.clear();
+    if (idx_bytes > 0) {
+        this->reserve(frame, index_offset + idx_bytes);
+
+        target.vtx_base.resize(lists);
+        target.idx_base.resize(lists);
+        target.batch_base.resize(lists);
+        target.batch_count.resize(lists);
+        uint32_t vtx_base = 0;
+        uint32_t idx_base = 0;
+        uint32_t commands = 0;
+        for (int l = 0; l < lists; ++l) {
+            target.vtx_base[l]   = vtx_base;
+            target.idx_base[l]   = idx_base;
+            target.batch_base[l] = commands;
+            vtx_base += draw_data->CmdLists[l]->VtxBuffer.Size;
+            idx_base += draw_data->CmdLists[l]->IdxBuffer.Size;
+            commands += draw_data->CmdLists[l]->CmdBuffer.Size;
+        }
+        target.batches.resize(commands);
+        target.batch_of.resize(commands);
+
+        // the one copy of the geometry, straight into memory the gpu reads,
+        // indices in the order of the batches
+        auto *vtx_dst = static_cast<ImDrawVert *>(frame.mapped);
+        auto *idx_dst = reinterpret_cast<ImDrawIdx *>(static_cast<char *>(frame.mapped)
+                                                      + index_offset);
+        tbb::parallel_for(tbb::blocked_range<int>(0, lists),
+                          [&](const tbb::blocked_range<int> &range) {
+                              for (int l = range.begin(); l != range.end(); ++l) {
+                                  const ImDrawList *list = draw_data->CmdLists[l];
+                                  std::memcpy(vtx_dst + target.vtx_base[l], list->VtxBuffer.Data,
+                                              list->VtxBuffer.Size * sizeof(ImDrawVert));
+                                  target.batch_count[l] = merge(
+                                      list, target.idx_base[l],
+                                      target.batches.data() + target.batch_base[l],
+                                      target.batch_of.data() + target.batch_base[l], idx_dst);
+                              }
+                          });
+        stats.upload_bytes = vtx_bytes + idx_bytes;
+
+        const uint32_t pieces = std::clamp<uint32_t>(
+            draw_data->TotalIdxCount / chunk_indices, 1,
+            static_cast<uint32_t>(tbb::this_task_arena::max_concurrency()));
+        split(target, draw_data, pieces, target.chunks);
+    }
+
+    const size_t chunks = target.chunks.size();
+    const bool   nested = chunks > 1;
+    if (nested) {
+        // secondaries inherit the render pass and framebuffer of this frame
+        for (size_t i = frame.pools.size(); i < chunks; ++i) {
+            VkCommandPoolCreateInfo pool_info = {};
+            pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            pool_info.queueFamilyIndex        = this->info.queue_family;
+            VkCommandPool pool;
+            err = vkCreateCommandPool(device, &pool_info, this->info.allocator, &pool);
+            check(err);
+
+            VkCommandBufferAllocateInfo alloc_info = {};
+            alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.commandPool        = pool;
+            alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            alloc_info.commandBufferCount = 1;
+            VkCommandBuffer command_buffer;
+            err = vkAllocateCommandBuffers(device, &alloc_info, &command_buffer);
+            check(err);
+
+            frame.pools.push_back(pool);
+            frame.secondaries.push_back(command_buffer);
+        }
+
+        target.chunk_stats.resize(chunks);
+        tbb::parallel_for(size_t(0), chunks, [&](size_t i) {
+            VkResult err = vkResetCommandPool(device, frame.pools[i], 0);
+            check(err);
+
+            VkCommandBufferInheritanceInfo inheritance = {};
+            inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance.renderPass  = wd->RenderPass;
+            inheritance.subpass     = 0;
+            inheritance.framebuffer = fd->Framebuffer;
+
+            VkCommandBufferBeginInfo begin_info = {};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+                               | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            begin_info.pInheritanceInfo = &inheritance;
+            err = vkBeginCommandBuffer(frame.secondaries[i], &begin_info);
+            check(err);
+
+            target.chunk_stats[i] = this->record_chunk(frame.secondaries[i], target, frame,
+                                                       index_offset, draw_data, target.chunks[i]);
+
+            err = vkEndCommandBuffer(frame.secondaries[i]);
+            check(err);
+        });
+    }
+
+    {
+        err = vkResetCommandPool(device, fd->CommandPool, 0);
+        check(err);
+        VkCommandBufferBeginInfo info = {};
+        info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        err = vkBeginCommandBuffer(fd->CommandBuffer, &info);
+        check(err);
+    }
+    {
+        VkRenderPassBeginInfo info    = {};
+        info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.renderPass               = wd->RenderPass;
+        info.framebuffer              = fd->Framebuffer;
+        info.renderArea.extent.width  = wd->Width;
+        info.renderArea.extent.height = wd->Height;
+        info.clearValueCount          = 1;
+        info.pClearValues             = &wd->ClearValue;
+        vkCmdBeginRenderPass(fd->CommandBuffer, &info,
+                             nested ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                    : VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    if (nested) {
+        vkCmdExecuteCommands(fd->CommandBuffer, static_cast<uint32_t>(chunks),
+                             frame.secondaries.data());
+        for (const Stats &chunk : target.chunk_stats) {
+            stats.commands += chunk.commands;
+            stats.draw_calls += chunk.draw_calls;
+        }
+        stats.secondaries = static_cast<uint32_t>(chunks);
+    } else if (chunks == 1) {
+        const Stats chunk = this->record_chunk(fd->CommandBuffer, target, frame, index_offset,
+                                               draw_data, target.chunks[0]);
+        stats.commands   = chunk.commands;
+        stats.draw_calls = chunk.draw_calls;
+    }
+
+    vkCmdEndRenderPass(fd->CommandBuffer);
+    err = vkEndCommandBuffer(fd->CommandBuffer);
+    check(err);
+    return stats;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <imgui.h>
+#include <imgui_impl_vulkan.h>
+#include <utility>
+#include <vector>
+
+// draws ImGui frames into the swapchain of a window, replaces
+// ImGui_ImplVulkan_RenderDrawData for large frames: the geometry is copied
+// once into persistently mapped buffers, draw commands of a list sharing a
+// state are merged into one draw call where no other draw in between
+// overlaps them and big frames are recorded into secondary command buffers
+// on several threads
+class Renderer {
+public:
+    struct InitInfo {
+        VkPhysicalDevice             physical_device;
+        VkDevice                     device;
+        VkQueue                      queue;
+        uint32_t                     queue_family;
+        VkDescriptorPool             descriptor_pool;
+        VkPipelineCache              pipeline_cache;
+        const VkAllocationCallbacks *allocator;
+    };
+
+    // what one window cost to record
+    struct Stats {
+        uint64_t upload_bytes{0};
+        uint32_t commands{0};
+        uint32_t draw_calls{0};
+        uint32_t secondaries{0};
+    };
+
+    // per window state, the buffers of a swapchain frame are reused once the
+    // gpu is done with that frame
+    class Target {
+    public:
+        Target()  = default;
+        ~Target() = default;
+
+    private:
+        friend class Renderer;
+
+        // draw commands of a list drawn by one draw call, cmd holds the state
+        // and the indices of the commands are uploaded back to back from
+        // first on, a callback is a batch of its own
+        struct Batch {
+            int      cmd;
+            uint32_t first;
+            uint32_t count;
+            uint32_t commands;
+        };
+
+        // contiguous run of batches recorded by one thread, from batch
+        // first_batch of list first_list up to but excluding batch
+        // last_batch of list last_list
+        struct Chunk {
+            int      first_list;
+            uint32_t first_batch;
+            int      last_list;
+            uint32_t last_batch;
+        };
+
+        struct Frame {
+            VkBuffer       buffer{VK_NULL_HANDLE};
+            VkDeviceMemory memory{VK_NULL_HANDLE};
+            VkDeviceSize   size{0};
+            void          *mapped{nullptr};
+
+            // one pool per chunk, a chunk is recorded by a single thread
+            std::vector<VkCommandPool>   pools;
+            std::vector<VkCommandBuffer> secondaries;
+        };
+
+        VkPipeline         pipeline{VK_NULL_HANDLE};
+        std::vector<Frame> frames;
+
+        // scratch of the last record, kept for the capacity
+        std::vector<Chunk>    chunks;
+        std::vector<uint32_t> vtx_base;
+        std::vector<uint32_t> idx_base;
+        std::vector<Stats>    chunk_stats;
+        // the batches of list l start at batch_base[l], the first command of
+        // the list, as a list never has more batches than commands
+        std::vector<uint32_t> batch_base;
+        std::vector<uint32_t> batch_count;
+        std::vector<Batch>    batches;
+        std::vector<uint32_t> batch_of;
+    };
+
+    explicit Renderer(const InitInfo &info);
+    ~Renderer();
+
+    Renderer(const Renderer &)            = delete;
+    Renderer &operator=(const Renderer &) = delete;
+
+    // the atlas all contexts drawn by this renderer share, upload it once the
+    // fonts are added
+    ImFontAtlas *get_font_atlas() {
+        return &this->font_atlas;
+    }
+
+    void upload_fonts();
+
+    // match the target to the swapchain of the window after it was created or
+    // rebuilt, UI thread only and nothing of the target may be in flight
+    void prepare(Target &target, const ImGui_ImplVulkanH_Window *wd);
+
+    void release(Target &target);
+
+    // record the frame into the command buffer of the acquired image, targets
+    // of different windows can be recorded concurrently unless the frame has
+    // user callbacks, those run on the calling thread and expect the UI thread
+    // with the context of the window current
+    Stats record(Target &target, ImGui_ImplVulkanH_Window *wd, ImDrawData *draw_data);
+
+    // whether the frame holds callbacks other than ImDrawCallback_ResetRenderState
+    static bool has_user_callbacks(const ImDrawData *draw_data);
+
+private:
+    struct Texture {
+        VkImage         image{VK_NULL_HANDLE};
+        VkImageView     view{VK_NULL_HANDLE};
+        VkDeviceMemory  memory{VK_NULL_HANDLE};
+        VkDescriptorSet descriptor_set{VK_NULL_HANDLE};
+    };
+
+    VkPipeline get_pipeline(VkFormat format, VkRenderPass render_pass);
+
+    void reserve(Target::Frame &frame, VkDeviceSize size);
+
+    void destroy_frame(Target::Frame &frame);
+
+    // group the commands of a list into batches and copy its indices in batch
+    // order to idx_dst, returns the number of batches
+    static uint32_t merge(const ImDrawList *list, uint32_t idx_base, Target::Batch *batches,
+                          uint32_t *batch_of, ImDrawIdx *idx_dst);
+
+    // cut the batches into at most count chunks of similar cost, a single
+    // chunk when user callbacks have to run on the calling thread
+    static void split(const Target &target, ImDrawData *draw_data, uint32_t count,
+                      std::vector<Target::Chunk> &chunks);
+
+    Stats record_chunk(VkCommandBuffer command_buffer, const Target &target,
+                       const Target::Frame &frame, VkDeviceSize index_offset,
+                       ImDrawData *draw_data, const Target::Chunk &chunk) const;
+
+    void setup_render_state(VkCommandBuffer command_buffer, VkPipeline pipeline, VkBuffer buffer,
+                            VkDeviceSize index_offset, ImDrawData *draw_data) const;
+
+    uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required,
+                              VkMemoryPropertyFlags preferred) const;
+
+    InitInfo                         info;
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+
+    VkDescriptorSetLayout descriptor_set_layout{VK_NULL_HANDLE};
+    VkPipelineLayout      pipeline_layout{VK_NULL_HANDLE};
+    VkSampler             sampler{VK_NULL_HANDLE};
+    VkShaderModule        vertex_shader{VK_NULL_HANDLE};
+    VkShaderModule        fragment_shader{VK_NULL_HANDLE};
+
+    // one pipeline per color format, the render passes of all windows with
+    // the same format are compatible
+    std::vector<std::pair<VkFormat, VkPipeline>> pipelines;
+
+    ImFontAtlas font_atlas;
+    Texture     font_texture;
+};
@@ -0,0 +1,12 @@
+#version 450 core
+
+layout(set = 0, binding = 0) uniform sampler2D texture_sampler;
+
+layout(location = 0) in vec4 in_color;
+layout(location = 1) in vec2 in_uv;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    out_color = in_color * texture(texture_sampler, in_uv);
+}
@@ -0,0 +1,24 @@
+#version 450 core
+
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec2 in_uv;
+layout(location = 2) in vec4 in_color;
+
+// maps the display rectangle to clip space
+layout(push_constant) uniform Transform {
+    vec2 scale;
+    vec2 translate;
+} transform;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec4 out_color;
+layout(location = 1) out vec2 out_uv;
+
+void main() {
+    out_color   = in_color;
+    out_uv      = in_uv;
+    gl_Position = vec4(in_position * transform.scale + transform.translate, 0.0, 1.0);
+}
@@ -3,7 +3,86 @@
 
 #include <GLFW/glfw3.h>
 
+void Widget::render_culled() {
+    // changes do not matter here, data bound widgets change nearly every
+    // frame and their containers would never be culled otherwise
+    if (this->measured && !ImGui::IsRectVisible(this->bounds)) {
+        // keep the layout and scroll extents of the container intact
+        ImGui::Dummy(this->bounds);
+        return;
+    }
+
+    ImGui::BeginGroup();
+    this->render();
+    ImGui::EndGroup();
+
+    this->bounds   = ImGui::GetItemRectSize();
+    this->measured = true;
+}
+
+void Boxes::render_widgets() {
+    for (auto &widget : this->widgets) {
+        if (widget) {
+            widget->render_culled();
+        }
+    }
+}
+
+void Boxes::render_cached() {
+    // replayed geometry has no items behind it, so a hovered window and one
+    // holding the active item are rendered live
+    const uint32_t current     = this->revision.load(std::memory_order_acquire);
+    const bool     interacting = ImGui::IsWindowHovered(ImGuiHoveredFlags_ChildWindows)
+                             || (this->live && ImGui::IsAnyItemActive());
+    if (!interacting && this->cache->valid(current)) {
+        this->cache->replay();
+        ImGui::Dummy(this->cache->get_size());
+        this->live = false;
+        return;
+    }
+
+    this->cache->begin_capture();
+    this->render_widgets();
+
+    this->live = interacting;
+    if (interacting) {
+        this->cache->clear();
+    } else {
+        this->cache->end_capture(current);
+    }
+}
+
+void Widget::invalidate() noexcept {
+    for (Widget *widget = this; widget != nullptr; widget = widget->parent) {
+        widget->revision.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void Widget::invalidate_structure() noexcept {
+    Widget *widget = this;
+    for (;; widget = widget->parent) {
+        widget->revision.fetch_add(1, std::memory_order_release);
+        if (widget->parent == nullptr) {
+            break;
+        }
+    }
+    widget->structure.fetch_add(1, std::memory_order_release);
+}
+
+void Widget::flush_invalidation(uint32_t pass) noexcept {
+    if (!this->changed) {
+        return;
+    }
+    this->changed = false;
+    // one bump per ancestor however many of its descendants changed
+    for (Widget *widget = this; widget != nullptr && widget->flushed != pass;
+         widget = widget->parent) {
+        widget->flushed = pass;
+        widget->revision.fetch_add(1, std::memory_order_release);
+    }
+}
+
 void ApplicationWindow::set_title(std::string title) {
     WindowWidget::set_title(title);
-    glfwSetWindowTitle(this->application->get_window(), title.c_str());
+    glfwSetWindowTitle(this->window->get_handle(), title.c_str());
 }
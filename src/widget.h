@@ -1,11 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <imgui.h>
 #include <memory>
 #include <vector>
 
 #include "application.h"
+#include "draw_cache.h"
 
 // events that
 
@@ -16,10 +18,86 @@ public:
     }
     virtual ~Widget() = default;
 
+    // compute the state shown by render(), runs on worker threads in parallel
+    // with the update of other widgets and must not call into ImGui
+    virtual void update(float dt) {
+        (void) dt;
+    }
+
+    // whether update() has anything to do, only those widgets are updated,
+    // a change of the answer has to call invalidate_structure()
+    virtual bool has_update() const {
+        return false;
+    }
+
+    // whether commit() may pick up anything, only those widgets are asked
+    virtual bool has_commit() const {
+        return false;
+    }
+
+    // emit the state computed by update(), runs on the UI thread
     virtual void render() = 0;
 
+    // visit the direct children of the widget
+    virtual void for_each_child(const std::function<void(Widget *)> &fn) {
+        (void) fn;
+    }
+
+    // pick up a subtree published from another thread, runs on the UI thread
+    // at the frame boundary and returns the subtree it replaced
+    virtual std::unique_ptr<Widget> commit() {
+        return nullptr;
+    }
+
+    // render the widget as a child of a container, when the bounds it had the
+    // last time it was rendered are clipped away only a dummy of the same
+    // size is emitted, a widget changing out of view is measured again once
+    // its old bounds come back into view
+    void render_culled();
+
+    // bump the revision of this widget and all of its ancestors so cached
+    // geometry containing them is captured again, must be called whenever
+    // the content of the widget changes outside of update()
+    void invalidate() noexcept;
+
+    // the same from update(), only flags the widget so the workers never touch
+    // shared ancestors, the application carries it upwards after the update
+    void invalidate_deferred() noexcept {
+        this->changed = true;
+    }
+
+    // apply a deferred invalidation to the widget and its ancestors on the UI
+    // thread, an ancestor already bumped in the same pass ends the walk
+    void flush_invalidation(uint32_t pass) noexcept;
+
+    // bumped on the root of a tree whenever a widget is added to or removed
+    // from it, or one starts or stops having an update
+    uint32_t get_structure() const noexcept {
+        return this->structure.load(std::memory_order_acquire);
+    }
+
+    void set_parent(Widget *parent) noexcept {
+        this->parent = parent;
+    }
+
 protected:
+    // invalidate() for a change of the shape of the tree below the widget
+    void invalidate_structure() noexcept;
+
     std::string name;
+
+    Widget *parent{nullptr};
+
+    // bumped on every invalidation, cached geometry is only replayed at the
+    // revision it was captured at
+    std::atomic<uint32_t> revision{0};
+    std::atomic<uint32_t> structure{0};
+    bool                  changed{false};
+    uint32_t              flushed{0};
+
+    // size of the widget the last time it was rendered
+    ImVec2 bounds{0.0f, 0.0f};
+    bool   measured{false};
 };
 
 class Boxes : public Widget {
@@ -38,29 +116,61 @@ public:
                                   | ImGuiWindowFlags_HorizontalScrollbar);
         }
 
-        for (auto &widget : this->widgets) {
-            widget->render();
+        if (this->cache) {
+            this->render_cached();
+        } else {
+            this->render_widgets();
         }
 
         ImGui::EndChild();
         ImGui::PopID();
     }
 
+    virtual void for_each_child(const std::function<void(Widget *)> &fn) override {
+        for (auto &widget : this->widgets) {
+            if (widget) {
+                fn(widget.get());
+            }
+        }
+    }
+
     void set_vertical(bool vertical) {
         this->vertical = vertical;
+        this->invalidate();
     }
 
     void set_size(uint32_t size) {
         this->widgets.resize(size);
+        this->invalidate_structure();
     }
 
     void set_widget(uint32_t idx, std::unique_ptr<Widget> widget) {
+        if (widget) {
+            widget->set_parent(this);
+        }
         this->widgets[idx] = std::move(widget);
+        this->invalidate_structure();
+    }
+
+    // record the geometry of the child window once and replay it while
+    // nothing below changed, widgets that change have to invalidate, and
+    // containers inside open child windows of their own so only a Boxes of
+    // leaves is ever captured
+    void set_cacheable(bool cacheable) {
+        this->cache = cacheable ? std::make_unique<DrawCache>() : nullptr;
     }
 
 private:
+    void render_widgets();
+
+    // replay the child window or render it live and capture it
+    void render_cached();
+
     bool                                 vertical{true};
     std::vector<std::unique_ptr<Widget>> widgets;
+
+    std::unique_ptr<DrawCache> cache;
+    bool                       live{false};
 };
 
 class Grid : public Widget {
@@ -74,13 +184,19 @@ public:
         ImGui::BeginChild("grid", ImVec2(0, 0), true, ImGuiWindowFlags_AlwaysAutoResize);
 
         for (auto &box : this->boxes) {
-            box->render();
+            box->render_culled();
         }
 
         ImGui::EndChild();
         ImGui::PopID();
     }
 
+    virtual void for_each_child(const std::function<void(Widget *)> &fn) override {
+        for (auto &box : this->boxes) {
+            fn(box.get());
+        }
+    }
+
     void set_rows(uint32_t rows) {
         if (this->rows >= rows) {
             return;
@@ -88,8 +204,12 @@ public:
         this->boxes.resize(rows);
         for (uint32_t i = this->rows; i < rows; ++i) {
             this->boxes[i] = std::make_unique<Boxes>("box" + std::to_string(i));
+            this->boxes[i]->set_parent(this);
             this->boxes[i]->set_size(this->columns);
+            this->boxes[i]->set_cacheable(this->cacheable);
         }
+        this->rows = rows;
+        this->invalidate_structure();
     }
 
     void set_columns(uint32_t columns) {
@@ -97,15 +217,26 @@ public:
         for (auto &box : this->boxes) {
             box->set_size(this->columns);
         }
+        this->invalidate_structure();
     }
 
     void set_widget(uint32_t row, uint32_t column, std::unique_ptr<Widget> widget) {
         this->boxes[row]->set_widget(column, std::move(widget));
     }
 
+    // the grid itself only holds the child windows of its rows, each row
+    // caches its own
+    void set_cacheable(bool cacheable) {
+        this->cacheable = cacheable;
+        for (auto &box : this->boxes) {
+            box->set_cacheable(cacheable);
+        }
+    }
+
 protected:
-    uint32_t rows    = 0;
-    uint32_t columns = 0;
+    uint32_t rows      = 0;
+    uint32_t columns   = 0;
+    bool     cacheable = false;
 
     std::vector<std::unique_ptr<Boxes>> boxes;
 };
@@ -135,18 +266,46 @@ public:
         ImGui::PopID();
     }
 
+    virtual void update(float dt) override {
+        (void) dt;
+        if (!this->source) {
+            return;
+        }
+        this->source(this->staged);
+        if (this->staged != this->text) {
+            std::swap(this->text, this->staged);
+            this->invalidate_deferred();
+        }
+    }
+
     void set_text(std::string text) {
         this->text = std::move(text);
+        this->invalidate();
+    }
+
+    // pull the text from a model on every update instead of set_text, the
+    // source formats into the given buffer to avoid reallocating each frame
+    void set_source(std::function<void(std::string &)> source) {
+        this->source = std::move(source);
+        this->invalidate_structure();
+    }
+
+    virtual bool has_update() const override {
+        return static_cast<bool>(this->source);
     }
 
     void set_border(float border) {
         this->border = border;
+        this->invalidate();
     }
 
 private:
     float       border{0.0f};
     bool        wrap{false};
     std::string text;
+    std::string staged;
+
+    std::function<void(std::string &)> source;
 };
 
 class WindowWidget : public Widget {
@@ -166,6 +325,12 @@ public:
         ImGui::PopID();
     }
 
+    virtual void for_each_child(const std::function<void(Widget *)> &fn) override {
+        if (this->root) {
+            fn(this->root.get());
+        }
+    }
+
     virtual void set_title(std::string title) {
         this->title = std::move(title);
     }
@@ -175,7 +340,11 @@ public:
     }
 
     void set_widget(std::unique_ptr<Widget> widget) {
+        if (widget) {
+            widget->set_parent(this);
+        }
         this->root = std::move(widget);
+        this->invalidate_structure();
     }
 
 protected:
@@ -184,10 +353,15 @@ protected:
     std::unique_ptr<Widget> root;
 };
 
+// root of an OS window, its title is the title of that window
 class ApplicationWindow : public WindowWidget {
 public:
+    ApplicationWindow(const std::string &name, Window *window) :
+        WindowWidget(name), window(window) {
+    }
+    // root of the primary window
     ApplicationWindow(const std::string &name, Application *app) :
-        WindowWidget(name), application(app) {
+        ApplicationWindow(name, app->get_primary_window()) {
     }
     virtual ~ApplicationWindow() = default;
 
@@ -206,7 +380,56 @@ public:
     virtual void set_title(std::string title) override;
 
 protected:
-    Application *application;
+    Window *window;
+};
+
+// holds a subtree that background threads can build off-thread and replace
+// wholesale, the new subtree becomes visible at the next frame boundary
+class Slot : public Widget {
+public:
+    Slot(const std::string &name) : Widget(name) {
+    }
+    virtual ~Slot() {
+        delete this->pending.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    virtual void render() override {
+        if (this->current) {
+            this->current->render();
+        }
+    }
+
+    virtual void for_each_child(const std::function<void(Widget *)> &fn) override {
+        if (this->current) {
+            fn(this->current.get());
+        }
+    }
+
+    virtual bool has_commit() const override {
+        return true;
+    }
+
+    virtual std::unique_ptr<Widget> commit() override {
+        Widget *next = this->pending.exchange(nullptr, std::memory_order_acquire);
+        if (next == nullptr) {
+            return nullptr;
+        }
+        next->set_parent(this);
+        std::unique_ptr<Widget> retired = std::move(this->current);
+        this->current.reset(next);
+        this->invalidate_structure();
+        return retired;
+    }
+
+    // safe to call from any thread, a subtree that was published but never
+    // committed is destroyed by the publishing thread
+    void publish(std::unique_ptr<Widget> widget) {
+        delete this->pending.exchange(widget.release(), std::memory_order_acq_rel);
+    }
+
+protected:
+    std::unique_ptr<Widget> current;
+    std::atomic<Widget *>   pending{nullptr};
 };
 
 class ButtonEvent {
@@ -235,6 +458,7 @@ public:
 
     void set_text(std::string text) {
         this->text = std::move(text);
+        this->invalidate();
     }
 
     void set_callback(std::function<void()> callback) {
@@ -259,14 +483,39 @@ public:
         ImGui::PopID();
     }
 
+    virtual void update(float dt) override {
+        (void) dt;
+        if (!this->source) {
+            return;
+        }
+        const float progress = this->source();
+        if (progress != this->progress) {
+            this->progress = progress;
+            this->invalidate_deferred();
+        }
+    }
+
     void set_progress(float progress) noexcept {
         this->progress = progress;
+        this->invalidate();
     }
 
     float get_progress() noexcept {
         return this->progress;
     }
 
+    // pull the progress from a model on every update instead of set_progress
+    void set_source(std::function<float()> source) {
+        this->source = std::move(source);
+        this->invalidate_structure();
+    }
+
+    virtual bool has_update() const override {
+        return static_cast<bool>(this->source);
+    }
+
 protected:
     float progress{0.0f};
+
+    std::function<float()> source;
 };
\ No newline at end of file